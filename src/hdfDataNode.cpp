@@ -105,6 +105,20 @@ std::vector<hdfValue> hdfDataNode::Values( const std::vector<hdfCoord> & locatio
 	return output;
 }
 
+void hdfDataNode::Tile( const hdfTile & tile, hdfValue * output, int stride )
+{
+	std::vector<hdfCoord> location( tile.height );
+	for( int i = 0; i < tile.width; i++ )
+	{
+		for( int j = 0; j < tile.height; j++ )
+		{
+			location[ j ] = tile.Location( i, j );
+		}
+		std::vector<hdfValue> column = Values( location );
+		std::copy( column.begin(), column.end(), output + i * stride );
+	}
+}
+
 std::list<hdfPolygon> hdfDataNode::GetMask() const
 {
 	std::list<hdfPolygon> combinedList;
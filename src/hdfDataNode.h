@@ -2,6 +2,7 @@
 #define HDFDATANODE_H_INCLUDED
 
 #include "hdfBase.h"
+#include "hdfTile.h"
 #include "ptr.h"
 #include "utility.h"
 
@@ -71,6 +72,13 @@ public:
 	//! Same as Value(), but samples many points at once.
 	virtual std::vector<hdfValue> Values( const std::vector<hdfCoord>& location );
 
+	//! Samples every pixel of a tile at its center.
+	//! Writes value ( tile.xMin + i, tile.yMin + j ) to output[ i * stride + j ].
+	//! The default calls Values() once per column of the tile, nodes that can
+	//! read whole blocks override it.
+	//! \see hdfTile
+	virtual void Tile( const hdfTile& tile, hdfValue* output, int stride );
+
 	//! Returns the mask, or a region that contains all points where the tree provides valid data.
 	//! Used to skip areas that do not have data.
 	virtual std::list<hdfPolygon> GetMask() const;
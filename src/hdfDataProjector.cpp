@@ -2,6 +2,19 @@
 #include "projector/som.h"
 #include "hdfDataSource.h"
 #include <iostream>
+#include <cmath>
+
+//! largest distance in meters between the batch and per point projections
+static const double s_batch_tolerance = 1.0;
+
+//! largest error in meters of the lattice interpolation
+static const double s_lattice_tolerance = 5.0;
+
+QMutex & projectorMutex()
+{
+	static QMutex mutex;
+	return mutex;
+}
 
 hdfDataProjector::hdfDataProjector( ptr<projector> theProjector )
 :
@@ -42,6 +55,8 @@ ptr<projector> hdfDataProjector::Projector() const
 void hdfDataProjector::setProjector( ptr<projector> theProjector )
 {
     proj = theProjector;
+    batch = 0;
+    lattice = 0;
 }
 
 void hdfDataProjector::setOrbit( int orbit )
@@ -54,6 +69,24 @@ void hdfDataProjector::setOrbit( int orbit )
 		if( field.IsValid() )
 		{
 			setProjector( new projectorSom( field->ProjectionParameters(), field->BlockRect() ) );
+
+			batch = new somBatch( field->ProjectionParameters() );
+			if( !CheckBatch( field->BlockRect() ) )
+			{
+				batch = 0;
+				return;
+			}
+
+			std::vector<hdfRect> blockRects( field->EndBlock() + 1 );
+			for( int i = field->StartBlock(); i <= field->EndBlock(); i++ )
+			{
+				blockRects[ i ] = field->BlockRect( i );
+			}
+			lattice = somLattice::FromPath( field->PathNumber(), field->ProjectionParameters(), blockRects );
+			if( !lattice->IsValid() || lattice->MaxError() > s_lattice_tolerance )
+			{
+				lattice = 0;
+			}
 		}
 		else
 		{
@@ -69,22 +102,107 @@ bool hdfDataProjector::Check() const
 
 hdfValue hdfDataProjector::Value( const hdfCoord & location )
 {
-    return inputs[ 0 ]->Value( proj->Project( location ) );
+	hdfCoord projected;
+	{
+		QMutexLocker locker( &projectorMutex() );
+		projected = proj->Project( location );
+	}
+    return inputs[ 0 ]->Value( projected );
 }
 
 std::vector<hdfValue> hdfDataProjector::Values( const std::vector<hdfCoord> & location )
 {
 	std::vector<hdfCoord> projected( location.size() );
-	for( unsigned int i = 0; i < location.size(); i++ )
+	if( !batch.IsValid() || location.empty() )
+	{
+		QMutexLocker locker( &projectorMutex() );
+		for( unsigned int i = 0; i < location.size(); i++ )
+		{
+			projected[ i ] = proj->Project( location[ i ] );
+		}
+		locker.unlock();
+		return inputs[ 0 ]->Values( projected );
+	}
+
+	const int count = int( location.size() );
+	std::vector<double> lon( count ), lat( count ), x( count ), y( count );
+	for( int i = 0; i < count; i++ )
+	{
+		lon[ i ] = location[ i ].x * pi / 180.0;
+		lat[ i ] = location[ i ].y * pi / 180.0;
+	}
+
+	if( lattice.IsValid() )
 	{
-		projected[ i ] = proj->Project( location[ i ] );
+		lattice->Forward( &lon[ 0 ], &lat[ 0 ], &x[ 0 ], &y[ 0 ], count );
+	}
+	else
+	{
+		batch->Forward( &lon[ 0 ], &lat[ 0 ], &x[ 0 ], &y[ 0 ], count );
+	}
+
+	// the batch itself needs no lock, it keeps its constants in the object
+	bool locked = false;
+	for( int i = 0; i < count; i++ )
+	{
+		// points that did not converge go through the projector
+		if( x[ i ] == x[ i ] )
+		{
+			projected[ i ] = hdfCoord( x[ i ], y[ i ] );
+		}
+		else
+		{
+			if( !locked )
+			{
+				projectorMutex().lock();
+				locked = true;
+			}
+			projected[ i ] = proj->Project( location[ i ] );
+		}
+	}
+	if( locked )
+	{
+		projectorMutex().unlock();
 	}
 	return inputs[ 0 ]->Values( projected );
 }
 
+bool hdfDataProjector::CheckBatch( const hdfRect& rect ) const
+{
+	// the corners and center of the rectangle in latitude, longitude
+	const int count = 5;
+	double x[ count ] = { rect.Left(), rect.Right(), rect.Left(), rect.Right(), rect.Center().x };
+	double y[ count ] = { rect.Top(), rect.Top(), rect.Bottom(), rect.Bottom(), rect.Center().y };
+	double lon[ count ], lat[ count ];
+
+	if( batch->Inverse( x, y, lon, lat, count ) != 0 )
+	{
+		return false;
+	}
+
+	double projX[ count ], projY[ count ];
+	if( batch->Forward( lon, lat, projX, projY, count ) != 0 )
+	{
+		return false;
+	}
+
+	QMutexLocker locker( &projectorMutex() );
+	for( int i = 0; i < count; i++ )
+	{
+		const hdfCoord expected = proj->Project( hdfCoord( lon[ i ] * 180.0 / pi, lat[ i ] * 180.0 / pi ) );
+		if( fabs( expected.x - projX[ i ] ) > s_batch_tolerance || fabs( expected.y - projY[ i ] ) > s_batch_tolerance )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 std::list<hdfPolygon> hdfDataProjector::GetMask() const
 {
-    return proj->UnProject( inputs[ 0 ]->GetMask() );
+	std::list<hdfPolygon> mask = inputs[ 0 ]->GetMask();
+	QMutexLocker locker( &projectorMutex() );
+    return proj->UnProject( mask );
 }
 
 bool hdfDataProjector::IsProjector() const
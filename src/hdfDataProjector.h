@@ -1,9 +1,18 @@
 #ifndef HDFDATAPROJECTOR_H_INCLUDED
 #define HDFDATAPROJECTOR_H_INCLUDED
 
+#include <qmutex.h>
+
 #include "hdfDataNode.h"
 #include "projector.h"
 #include "ptr.h"
+#include "somBatch.h"
+#include "somLattice.h"
+
+//! Serializes calls into projectors.
+//! The projectors use gctp, which keeps the projection it was last set up
+//! for in static storage, so only one thread at a time may project points.
+QMutex & projectorMutex();
 
 //! A data node that converts the location from one projection to another.
 //! This is commonly used to convert MISR data from its native SOM
@@ -35,9 +44,13 @@ public:
     ptr<projector> Projector() const;
 
 	//! Sets the projector used to transform locations.
+	//! Values() uses the projector one point at a time.
 	void setProjector( ptr<projector> theProjector );
 
 	//! Sets the active orbit, updating projection parameters.
+	//! Values() then projects all points in one batch when the batch SOM
+	//! projection agrees with the projector, interpolating the path's
+	//! lattice where it is accurate enough.
 	virtual void setOrbit( int orbit );
 
 	//! Checks the tree for any missing data.
@@ -66,7 +79,12 @@ protected:
 	//! multiple children.
 	virtual void PromoteProjectorsTo( ptr<hdfDataNode>& parent, ptr<hdfDataNode>& dest );
 
+	//! Returns true if the batch projection gives the same result as the projector around a rectangle.
+	bool CheckBatch( const hdfRect& rect ) const;
+
 	ptr<projector> proj; //!< the projector used to transform locations
+	ptr<somBatch> batch; //!< projects many locations at once for Values(), if valid
+	ptr<somLattice> lattice; //!< interpolates the batch projection for Values(), if valid
 };
 
 #endif // HDFDATAPROJECTOR_H_INCLUDED
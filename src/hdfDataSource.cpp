@@ -1,9 +1,145 @@
 
 #include <math.h>
+#include <qmutex.h>
 
 #include "hdfDataSource.h"
 #include "fileHandler.h"
 
+//! serializes reading blocks, since the hdf library is not thread safe
+static QMutex s_read_lock;
+
+//! Point sampler for fields of one data type.
+//! Keeps the block rectangles and the fill value as plain values, so a sample
+//! costs a few arithmetic operations and a single typed comparison.
+template<class dataType>
+class hdfTypedPointSampler : public hdfPointSampler
+{
+public:
+
+	hdfTypedPointSampler( hdfDataSource & theSource )
+	:
+	source( theSource ),
+	startBlock( theSource.DataField()->StartBlock() ),
+	endBlock( theSource.DataField()->EndBlock() ),
+	xDim( theSource.DataField()->XDim() ),
+	yDim( theSource.DataField()->YDim() ),
+	blocks( endBlock - startBlock + 1 )
+	{
+		const hdfField & field = theSource.DataField();
+
+		firstLeft = field->BlockRect( startBlock ).Left();
+		metersPerBlock = fabs( field->BlockRect( startBlock ).Width() );
+		memcpy( &fillValue, field->FillValue(), sizeof( dataType ) );
+
+		for( int blockIndex = startBlock; blockIndex <= endBlock; blockIndex++ )
+		{
+			const hdfRect & rect = field->BlockRect( blockIndex );
+			blockFrame & block = blocks[ blockIndex - startBlock ];
+
+			block.left = rect.Left();
+			block.top = rect.Top();
+			block.width = rect.Width();
+			block.height = rect.Height();
+		}
+	}
+
+	virtual hdfValue Sample( const hdfCoord & location )
+	{
+		int blockIndex = startBlock + int( ( location.x - firstLeft ) / metersPerBlock );
+
+		if( blockIndex < startBlock || blockIndex > endBlock )
+		{
+			return hdfValue( 0.0, 0.0 );
+		}
+
+		const blockFrame & block = blocks[ blockIndex - startBlock ];
+		hdfScalar x = ( location.x - block.left ) / block.width;
+		hdfScalar y = ( location.y - block.top ) / block.height;
+
+		if( x < 0 || x >= 1 || y < 0 || y >= 1 )
+		{
+			return hdfValue( 0.0, 0.0 );
+		}
+
+		source.LoadBlock( blockIndex );
+
+		const dataType * data = ( const dataType * ) & source.blockList[ blockIndex ][ 0 ];
+		const dataType & value = data[ int( xDim * x ) * yDim + int( yDim * y ) ];
+
+		if( memcmp( &value, &fillValue, sizeof( dataType ) ) == 0 )
+		{
+			return hdfValue( 0.0, 0.0 );
+		}
+
+		return hdfValue( hdfScalar( value ), 1 );
+	}
+
+	virtual void Sample( const hdfCoord * location, hdfValue * output, int count )
+	{
+		for( int i = 0; i < count; i++ )
+		{
+			output[ i ] = Sample( location[ i ] );
+		}
+	}
+
+	virtual void Sample( const hdfTile & tile, hdfValue * output, int stride )
+	{
+		source.LoadBlock( tile.block );
+
+		const dataType * data = ( const dataType * ) & source.blockList[ tile.block ][ 0 ];
+
+		for( int i = 0; i < tile.width; i++ )
+		{
+			const int x = tile.xMin + i;
+			hdfValue * out = output + i * stride;
+
+			for( int j = 0; j < tile.height; j++ )
+			{
+				const int y = tile.yMin + j;
+
+				if( x < 0 || x >= xDim || y < 0 || y >= yDim )
+				{
+					// pixels past the block edges belong to other blocks, or to none
+					out[ j ] = Sample( tile.Location( i, j ) );
+					continue;
+				}
+
+				const dataType & value = data[ x * yDim + y ];
+
+				if( memcmp( &value, &fillValue, sizeof( dataType ) ) == 0 )
+				{
+					out[ j ] = hdfValue( 0.0, 0.0 );
+				}
+				else
+				{
+					out[ j ] = hdfValue( hdfScalar( value ), 1 );
+				}
+			}
+		}
+	}
+
+protected:
+
+	//! block rectangle in native projection
+	struct blockFrame
+	{
+		hdfScalar left;
+		hdfScalar top;
+		hdfScalar width;
+		hdfScalar height;
+	};
+
+	hdfDataSource & source; //!< source owning the block data
+	int startBlock; //!< first block of the field
+	int endBlock; //!< last block of the field
+	int xDim; //!< samples per block along x
+	int yDim; //!< samples per block along y
+	hdfScalar firstLeft; //!< left edge of the first block
+	hdfScalar metersPerBlock; //!< width of a block
+	dataType fillValue; //!< samples equal to this have no data
+	std::vector<blockFrame> blocks; //!< rectangles of blocks startBlock to endBlock
+};
+
 hdfDataSource::hdfDataSource( hdfField theDataField, const std::vector<int> & dims )
 :
 hdfDataNode(),
@@ -32,14 +168,16 @@ void hdfDataSource::setDataField( hdfField theDataField )
 	if( theDataField != dataField )
 	{
 		dataField = theDataField;
-		blockList.clear();
+		Flush();
 		if( dataField.IsValid() )
 		{
 			name = dataField->Name();
 			cameraName = dataField->CameraName();
 			dataField->Open();
 			blockList.resize( dataField->NumBlocks() );
+			blockLoaded.resize( dataField->NumBlocks() );
 		}
+		sampler = MakeSampler();
 	}
 }
 
@@ -53,8 +191,9 @@ void hdfDataSource::setDimensions( const std::vector<int> & dims )
 	if( dims != dimensionList )
 	{
 		dimensionList = dims;
-		blockList.clear();
+		Flush();
 		blockList.resize( dataField->NumBlocks() );
+		blockLoaded.resize( dataField->NumBlocks() );
 	}
 }
 
@@ -78,49 +217,35 @@ const hdfDataSource* hdfDataSource::FindDataSource() const
 	return this;
 }
 
-hdfValue hdfDataSource::SampleAt( const hdfCoord & location )
+hdfValue hdfDataSource::Value( const hdfCoord & location )
 {
-	hdfScalar metersPerBlock = fabs( dataField->BlockRect( dataField->StartBlock() ).Width() );
-
-	int blockIndex = dataField->StartBlock() + int( ( location.x - dataField->BlockRect( dataField->StartBlock() ).Left() ) / metersPerBlock );
-
-	if ( blockIndex >= dataField->StartBlock() && blockIndex <= dataField->EndBlock() )
+	if( !sampler.IsValid() )
 	{
-		hdfCoord dataCoord = dataField->BlockRect( blockIndex ).ConvertLocal( location );
-
-		if ( dataCoord.x >= 0 && dataCoord.x < 1 && dataCoord.y >= 0 && dataCoord.y < 1 )
-		{
-			LoadBlock( blockIndex );
-
-			int blockX = int( dataField->XDim() * dataCoord.x );
-			int blockY = int( dataField->YDim() * dataCoord.y );
-
-			unsigned char *dataPoint = (unsigned char *)&blockList[ blockIndex ][ 0 ]
-				+ ( blockX * dataField->YDim() + blockY ) * dataField->DataSize();
-
-			if ( memcmp( dataPoint, dataField->FillValue(), dataField->DataSize() ) != 0 )
-			{
-				return hdfValue( ConvertToCommon( dataPoint ), 1 );
-			}
-		}
+		return hdfValue( 0.0, 0.0 );
 	}
-
-	return hdfValue( 0.0, 0.0 );
+	return sampler->Sample( location );
 }
 
-hdfValue hdfDataSource::Value( const hdfCoord & location )
+std::vector<hdfValue> hdfDataSource::Values( const std::vector<hdfCoord> & location )
 {
-	return SampleAt( location );
+	std::vector<hdfValue> output( location.size(), hdfValue( 0.0, 0.0 ) );
+	if( sampler.IsValid() && !location.empty() )
+	{
+		sampler->Sample( & location[ 0 ], & output[ 0 ], int( location.size() ) );
+	}
+	return output;
 }
 
-std::vector<hdfValue> hdfDataSource::Values( const std::vector<hdfCoord> & location )
+void hdfDataSource::Tile( const hdfTile & tile, hdfValue * output, int stride )
 {
-	std::vector<hdfValue> output( location.size() );
-	for( unsigned int i = 0; i < location.size(); i++ )
+	if( !sampler.IsValid() || tile.block < dataField->StartBlock() || tile.block > dataField->EndBlock()
+		|| !tile.IsOnGrid( dataField->BlockRect( tile.block ), dataField->XDim(), dataField->YDim() ) )
 	{
-		output[ i ] = SampleAt( location[ i ] );
+		hdfDataNode::Tile( tile, output, stride );
+		return;
 	}
-	return output;
+
+	sampler->Sample( tile, output, stride );
 }
 
 std::list<hdfPolygon> hdfDataSource::GetMask() const
@@ -168,15 +293,48 @@ matrix<hdfValue> hdfDataSource::GetBlock( int blockIndex )
 void hdfDataSource::Flush()
 {
 	blockList.clear();
+	blockLoaded.clear();
 }
 
 void hdfDataSource::LoadBlock( int blockIndex )
 {
+	// once a block is loaded it is only read, so threads rendering the same
+	// image only take the lock for blocks they have not seen loaded
+	if ( blockLoaded[ blockIndex ].testAndSetAcquire( 1, 1 ) )
+	{
+		return;
+	}
+
+	QMutexLocker locker( &s_read_lock );
 	if ( blockList[ blockIndex ].empty() )
 	{
 		blockList[ blockIndex ].resize( DataField()->BlockMemSize() );
 		DataField()->ReadBlock( & blockList[ blockIndex ][ 0 ], blockIndex, Dimensions() );
 	}
+	blockLoaded[ blockIndex ].fetchAndStoreRelease( 1 );
+}
+
+ptr<hdfPointSampler> hdfDataSource::MakeSampler()
+{
+	if( !dataField.IsValid() )
+	{
+		return 0;
+	}
+
+	switch ( dataField->DataType() )
+	{
+		case hdfChar8:    return new hdfTypedPointSampler<char8>( *this );
+		case hdfUChar8:   return new hdfTypedPointSampler<uchar8>( *this );
+		case hdfInt8:     return new hdfTypedPointSampler<int8>( *this );
+		case hdfUInt8:    return new hdfTypedPointSampler<uint8>( *this );
+		case hdfInt16:    return new hdfTypedPointSampler<int16>( *this );
+		case hdfUInt16:   return new hdfTypedPointSampler<uint16>( *this );
+		case hdfInt32:    return new hdfTypedPointSampler<int32>( *this );
+		case hdfUInt32:   return new hdfTypedPointSampler<uint32>( *this );
+		case hdfFloat32:  return new hdfTypedPointSampler<float32>( *this );
+		case hdfFloat64:  return new hdfTypedPointSampler<float64>( *this );
+		default:          return 0;
+	}
 }
 
 hdfScalar hdfDataSource::ConvertToCommon( void * data ) const
@@ -3,6 +3,7 @@
 
 #include <list>
 #include <vector>
+#include <qatomic.h>
 
 #include "matrix.h"
 #include "hdfBase.h"
@@ -10,11 +11,37 @@
 #include "hdfDataOp.h"
 #include "hdfField.h"
 
+//! Samples the field of a data source at single points.
+//! Created once per field so that the block layout and fill value are looked
+//! up once, instead of for every point.
+class hdfPointSampler
+{
+public:
+
+	//! Destructor
+	virtual ~hdfPointSampler() {}
+
+	//! Samples one point using nearest neighbor sampling.
+	//! If there is no data available at a location, returns 0 with a coverage of 0.
+	virtual hdfValue Sample( const hdfCoord & location ) = 0;
+
+	//! Same as Sample(), but samples count points into output.
+	virtual void Sample( const hdfCoord * location, hdfValue * output, int count ) = 0;
+
+	//! Samples every pixel of a tile on the grid of one of the field's blocks.
+	//! Pixels inside the block are read straight from the block data.
+	virtual void Sample( const hdfTile & tile, hdfValue * output, int stride ) = 0;
+};
+
+template<class dataType> class hdfTypedPointSampler;
+
 //! data node that accesses a field in a hdf file.
 //! Caches the data to speed up subsequent accesses.
 //! This data node has no inputs.
 class hdfDataSource : public hdfDataNode
 {
+	template<class dataType> friend class hdfTypedPointSampler;
+
 public:
 
 	//! Construct a new data source.
@@ -64,6 +91,10 @@ public:
 	//! Same as Value(), but samples many points at once.
 	virtual std::vector<hdfValue> Values( const std::vector<hdfCoord> & location );
 
+	//! Samples a tile straight from the block data.
+	//! Tiles that do not lie on the field's block grid are sampled with Values().
+	virtual void Tile( const hdfTile & tile, hdfValue * output, int stride );
+
 	//! Returns the block regions as a list of polygons.
 	virtual std::list<hdfPolygon> GetMask() const;
 
@@ -75,10 +106,12 @@ public:
 
 protected:
 
-	//! Helper function used by Value() and Values() that actually samples data.
-	hdfValue SampleAt( const hdfCoord & location );
+	//! Creates the point sampler for the data type of the data field.
+	//! Returns an invalid pointer if the field is invalid or of an unknown type.
+	ptr<hdfPointSampler> MakeSampler();
 
 	//! Makes sure that a block is in memory.
+	//! Safe to call from several threads at once.
 	//! \param blockIndex index of the block to load
 	void LoadBlock( int blockIndex );
 
@@ -89,6 +122,8 @@ protected:
 	std::vector<int> dimensionList; //!< visible slice in extra dimensions
 	hdfRect dataRect; //!< bounding rectangle for data in native projection
 	std::vector<std::vector<unsigned char> > blockList; //!< stores data for individual blocks
+	std::vector<QAtomicInt> blockLoaded; //!< nonzero for blocks in blockList that have been read
+	ptr<hdfPointSampler> sampler; //!< samples the data field for Value() and Values()
 	QString name; //!< the name of the field used for reading data
 	QString cameraName; //!< the camera name of the field used for reading data
 };
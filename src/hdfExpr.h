@@ -0,0 +1,126 @@
+#ifndef HDFEXPR_H_INCLUDED
+#define HDFEXPR_H_INCLUDED
+
+#include <vector>
+
+#include "hdfBase.h"
+
+//! Expression templates over the hdfDataOp functors.
+//! A chain of operations that is known at compile time, such as the BRF and
+//! BDAS products, can be written as a single expression over buffers holding
+//! the values of its leaves. hdfExprEvaluate() then computes the result in one
+//! loop, with no intermediate buffer per operation and no virtual calls.
+//! Trees built at run time keep using hdfOpBinary and hdfOpUnary.
+//! \code
+//! hdfExprEvaluate( hdfExpr( hdfOpBinarySub(), hdfExprBuffer( a ), hdfExprBuffer( b ) ), output );
+//! \endcode
+
+//! Leaf of an expression, reads values from a buffer.
+class hdfExprBuffer
+{
+public:
+
+	//! Constructs a leaf reading from theData.
+	hdfExprBuffer( const hdfValue * theData )
+	:
+	data( theData )
+	{
+
+	}
+
+	//! Returns the value at an index of the buffer.
+	hdfValue operator [] ( int index ) const
+	{
+		return data[ index ];
+	}
+
+protected:
+
+	const hdfValue * data; //!< values of the leaf
+};
+
+//! Expression applying a unary functor to another expression.
+//! \see hdfOpUnary
+template <typename functor, typename input>
+class hdfExprUnary
+{
+public:
+
+	//! Constructs the expression operation( theInput ).
+	hdfExprUnary( const functor & theOperation, const input & theInput )
+	:
+	operation( theOperation ),
+	in( theInput )
+	{
+
+	}
+
+	//! Returns the result of the operation at an index.
+	hdfValue operator [] ( int index ) const
+	{
+		return operation( in[ index ] );
+	}
+
+protected:
+
+	functor operation; //!< an instance of a unary operation function object
+	input in; //!< expression for the argument
+};
+
+//! Expression applying a binary functor to two other expressions.
+//! \see hdfOpBinary
+template <typename functor, typename input0, typename input1>
+class hdfExprBinary
+{
+public:
+
+	//! Constructs the expression operation( theInput0, theInput1 ).
+	hdfExprBinary( const functor & theOperation, const input0 & theInput0, const input1 & theInput1 )
+	:
+	operation( theOperation ),
+	in0( theInput0 ),
+	in1( theInput1 )
+	{
+
+	}
+
+	//! Returns the result of the operation at an index.
+	hdfValue operator [] ( int index ) const
+	{
+		return operation( in0[ index ], in1[ index ] );
+	}
+
+protected:
+
+	functor operation; //!< an instance of a binary operation function object
+	input0 in0; //!< expression for the first argument
+	input1 in1; //!< expression for the second argument
+};
+
+//! Returns the expression operation( in ).
+template <typename functor, typename input>
+hdfExprUnary<functor, input> hdfExpr( const functor & operation, const input & in )
+{
+	return hdfExprUnary<functor, input>( operation, in );
+}
+
+//! Returns the expression operation( in0, in1 ).
+template <typename functor, typename input0, typename input1>
+hdfExprBinary<functor, input0, input1> hdfExpr( const functor & operation, const input0 & in0, const input1 & in1 )
+{
+	return hdfExprBinary<functor, input0, input1>( operation, in0, in1 );
+}
+
+//! Evaluates an expression for every index of output.
+template <typename expression>
+void hdfExprEvaluate( const expression & expr, std::vector<hdfValue> & output )
+{
+	const int size = int( output.size() );
+
+	for ( int i = 0 ; i < size ; i++ )
+	{
+		output[ i ] = expr[ i ];
+	}
+}
+
+#endif // HDFEXPR_H_INCLUDED
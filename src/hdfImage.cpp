@@ -1,14 +1,108 @@
+#include <cmath>
+#include <limits>
+#include <qatomic.h>
 #include <qfile.h>
 #include <qpainter.h>
 #include <qstring.h>
 #include <qtextstream.h>
 
 #include "hdfDataOp.h"
+#include "hdfDataProjector.h"
+#include "hdfDataSource.h"
 #include "hdfImage.h"
 #include "qutility.h"
 #include "utility.h"
 #include "projector/geographic.h"
 
+//! width and height in pixels of the tiles rendered by each thread
+static const int s_render_tile_size = 64;
+
+//! milliseconds between progress updates while rendering
+static const int s_render_progress_interval = 100;
+
+//! Orders mask spans by their first column.
+static bool earlierSpan( const interval<int> & a, const interval<int> & b )
+{
+	return a.min < b.min;
+}
+
+//! Renders tiles of a Render() call until none are left.
+//! Every task takes the next tile as it finishes one, so threads that get
+//! cheap tiles, such as tiles outside the mask, take more of them.
+class hdfImage::renderTask : public QRunnable
+{
+public:
+
+	renderTask( hdfImage & theImage, const std::vector<renderItem> & theItems, QAtomicInt & theNextTile, QAtomicInt & theTilesDone )
+	:
+	image( theImage ),
+	items( theItems ),
+	nextTile( theNextTile ),
+	tilesDone( theTilesDone )
+	{
+
+	}
+
+	virtual void run()
+	{
+		renderContext context;
+		for( int i = nextTile.fetchAndAddRelaxed( 1 ); i < int( items.size() ); i = nextTile.fetchAndAddRelaxed( 1 ) )
+		{
+			image.RenderTile( items[ i ].tile, items[ i ].channels, context );
+			tilesDone.fetchAndAddRelease( 1 );
+		}
+	}
+
+protected:
+
+	hdfImage & image; //!< the image being rendered
+	const std::vector<renderItem> & items; //!< tiles of the Render() call
+	QAtomicInt & nextTile; //!< index of the next tile to render
+	QAtomicInt & tilesDone; //!< number of tiles finished
+};
+
+//! lines colorized by each task at a time
+static const int s_colorize_lines = 16;
+
+//! number of intervals in the color lookup table
+static const int s_color_lookup_size = 1024;
+
+//! Colorizes lines of a Colorize() call until none are left.
+class hdfImage::colorizeTask : public QRunnable
+{
+public:
+
+	colorizeTask( const hdfImage & theImage, const intRect & theRegion, uchar * theBits, int theBytesPerLine, QAtomicInt & theNextLine )
+	:
+	image( theImage ),
+	region( theRegion ),
+	bits( theBits ),
+	bytesPerLine( theBytesPerLine ),
+	nextLine( theNextLine )
+	{
+
+	}
+
+	virtual void run()
+	{
+		for( int y = nextLine.fetchAndAddRelaxed( s_colorize_lines ); y < region.Bottom(); y = nextLine.fetchAndAddRelaxed( s_colorize_lines ) )
+		{
+			for( int end = std::min( y + s_colorize_lines, region.Bottom() ); y < end; y++ )
+			{
+				image.ColorizeLine( ( QRgb * ) ( bits + y * bytesPerLine ), y, region.Left(), region.Right() );
+			}
+		}
+	}
+
+protected:
+
+	const hdfImage & image; //!< the image being colorized
+	intRect region; //!< pixels to colorize
+	uchar * bits; //!< the image pixels
+	int bytesPerLine; //!< distance between lines of bits
+	QAtomicInt & nextLine; //!< the next line to colorize
+};
+
 hdfImage::hdfImage( int width, int height )
 :
 outputProjector( new projectorGeographic() ),
@@ -25,6 +119,7 @@ overSampling( 1 )
 	colorMap.setDomain( 0, 1 );
 	colorMap.Insert( 0, color( 0, 0, 0 ) );
 	colorMap.Insert( 1, color( 1, 1, 1 ) );
+	UpdateColorLookup();
 
 	static QPainterPath boundariesPath[3];
 	std::fill( boundaryProjector, boundaryProjector + 3, ( projector * ) 0 );
@@ -145,6 +240,7 @@ void hdfImage::setOutputRange( const hdfScalar & min, const hdfScalar & max )
 	outputMax = max;
 
 	colorMap.setDomain( OutputMin(), OutputMax() );
+	UpdateColorLookup();
 }
 
 void hdfImage::setOutputMin( const hdfScalar & min )
@@ -318,64 +414,376 @@ void hdfImage::Render( int xMin, int yMin, int xMax, int yMax )
 {
 	if( !InputsValid() ) return;
 
+	// forget the tiles of outputs whose inputs or view changed
 	const int numInputs = input.size();
-	std::vector<hdfScalar> sampleOffset = SampleOffsets( overSampling );
-	hdfScalar oneOverNumSamples = 1.0 / ( overSampling * overSampling );
+	const int tileRows = ( Height() + s_render_tile_size - 1 ) / s_render_tile_size;
+	const int tileCols = ( Width() + s_render_tile_size - 1 ) / s_render_tile_size;
+	bool changed = int( maskSpans.size() ) != Height();
+	samples.resize( numInputs );
+	for( int i = 0; i < numInputs; i++ )
+	{
+		sampleKey key = SampleKey( i );
+		if( !( key == samples[ i ].key ) )
+		{
+			samples[ i ].key = key;
+			samples[ i ].tiles.resize( tileRows, tileCols, 0 );
+			samples[ i ].tiles = 0;
+			changed = true;
+		}
+	}
+	if( changed )
+	{
+		UpdateMaskSpans();
+	}
 
-	for( int y = yMin ; y < yMax ; ++y )
+	// split the region into tiles on the cache grid, in line order so
+	// progress follows the lines, skipping tiles that are already sampled
+	std::vector<renderItem> items;
+	for( int y = yMin - yMin % s_render_tile_size; y < yMax; y += s_render_tile_size )
 	{
-		for( int x = xMin ; x < xMax ; ++x )
+		for( int x = xMin - xMin % s_render_tile_size; x < xMax; x += s_render_tile_size )
 		{
-			if( outImage.pixel( x, y ) )
+			renderItem item;
+			item.tile = intRect( max( x, xMin ), max( y, yMin ), min( x + s_render_tile_size, xMax ), min( y + s_render_tile_size, yMax ) );
+			item.channels = 0;
+			for( int i = 0; i < numInputs; i++ )
 			{
-				// clear sample
-				for( int i = 0; i < numInputs; i++ )
+				if( !samples[ i ].tiles( y / s_render_tile_size, x / s_render_tile_size ) )
 				{
-					output[ i ]( y, x ) = hdfValue( 0, 0 );
+					item.channels |= 1 << i;
 				}
+			}
+			if( !item.channels )
+			{
+				continue;
+			}
 
-				// accumulate sample values, weighted by coverage
+			if( IsMasked( item.tile ) )
+			{
+				items.push_back( item );
+				continue;
+			}
+
+			// tiles outside the mask are cleared here instead of sampled
+			for( int i = 0; i < numInputs; i++ )
+			{
+				if( item.channels & ( 1 << i ) )
+				{
+					for( int yClear = item.tile.Top(); yClear < item.tile.Bottom(); yClear++ )
+					{
+						std::fill( output[ i ].at( yClear, item.tile.Left() ), output[ i ].at( yClear, item.tile.Right() ), hdfValue( 0, 0 ) );
+					}
+				}
+			}
+			MarkSampled( item );
+		}
+	}
+
+	const int numTiles = items.size();
+	const int numTasks = min( numTiles, renderPool.maxThreadCount() );
+	if( numTasks <= 1 )
+	{
+		renderContext context;
+		for( int i = 0; i < numTiles; i++ )
+		{
+			RenderTile( items[ i ].tile, items[ i ].channels, context );
+			progressNotify( items[ i ].tile.Bottom() - 1, yMin, yMax );
+		}
+	}
+	else
+	{
+		QAtomicInt nextTile( 0 );
+		QAtomicInt tilesDone( 0 );
+		for( int i = 0; i < numTasks; i++ )
+		{
+			renderPool.start( new renderTask( *this, items, nextTile, tilesDone ) );
+		}
+
+		// report progress from this thread while the pool works
+		while( !renderPool.waitForDone( s_render_progress_interval ) )
+		{
+			const int done = tilesDone;
+			if( done > 0 )
+			{
+				progressNotify( items[ done - 1 ].tile.Bottom() - 1, yMin, yMax );
+			}
+		}
+	}
+	progressNotify( yMax - 1, yMin, yMax );
+
+	for( int k = 0; k < numTiles; k++ )
+	{
+		MarkSampled( items[ k ] );
+	}
+}
+
+void hdfImage::MarkSampled( const renderItem & item )
+{
+	// only tiles that were sampled completely are kept
+	const intRect & tile = item.tile;
+	const int row = tile.Top() / s_render_tile_size;
+	const int col = tile.Left() / s_render_tile_size;
+	if( tile.Width() == min( s_render_tile_size, Width() - col * s_render_tile_size )
+		&& tile.Height() == min( s_render_tile_size, Height() - row * s_render_tile_size ) )
+	{
+		for( unsigned int i = 0; i < samples.size(); i++ )
+		{
+			if( item.channels & ( 1 << i ) )
+			{
+				samples[ i ].tiles( row, col ) = 1;
+			}
+		}
+	}
+}
+
+void hdfImage::FlushSamples()
+{
+	samples.clear();
+}
+
+void hdfImage::RenderTile( const intRect & tile, unsigned int channels, renderContext & context )
+{
+	const int numInputs = input.size();
+	const int numSamples = overSampling * overSampling;
+	std::vector<hdfScalar> sampleOffset = SampleOffsets( overSampling );
+	hdfScalar oneOverNumSamples = 1.0 / numSamples;
+
+	for( int y = tile.Top() ; y < tile.Bottom() ; ++y )
+	{
+		// clear the line, then find the lat/lon location of every sample in the mask
+		for( int i = 0; i < numInputs; i++ )
+		{
+			if( channels & ( 1 << i ) )
+			{
+				std::fill( output[ i ].at( y, tile.Left() ), output[ i ].at( y, tile.Right() ), hdfValue( 0, 0 ) );
+			}
+		}
+
+		context.columns.clear();
+		context.samples.clear();
+		const std::vector< interval<int> > & spans = maskSpans[ y ];
+		for( unsigned int k = 0; k < spans.size(); k++ )
+		{
+			for( int x = max( spans[ k ].min, tile.Left() ) ; x < min( spans[ k ].max, tile.Right() ) ; ++x )
+			{
+				context.columns.push_back( x );
 				for( int ys = 0; ys < overSampling; ys++ )
 				{
 					for( int xs = 0; xs < overSampling; xs++ )
 					{
-						// find the lat/lon location of the sample
 						hdfCoord imageSample( hdfScalar( x ) + sampleOffset[ xs ],
 										 hdfScalar( y ) + sampleOffset[ ys ] );
-						hdfCoord worldSample = outputProjector->UnProject(
-							viewRect.ConvertGlobal(	imageRect.ConvertLocal( imageSample ) ) );
-
-						for( int i = 0; i < numInputs; i++ )
-						{
-							hdfValue rawData( input[ i ]->Value( worldSample ) );
-							hdfValue weightedData( rawData.x * rawData.y, rawData.y );
-							output[ i ]( y, x ) += weightedData;
-						}
+						context.samples.push_back( viewRect.ConvertGlobal( imageRect.ConvertLocal( imageSample ) ) );
 					}
 				}
-				
-				// divide by number of samples
-				for( int i = 0; i < numInputs; i++ )
+			}
+		}
+
+		if( context.samples.empty() )
+		{
+			continue;
+		}
+
+		// unproject the whole line at once, other tiles wait for the projector
+		{
+			QMutexLocker locker( &projectorMutex() );
+			for( unsigned int s = 0; s < context.samples.size(); s++ )
+			{
+				context.samples[ s ] = outputProjector->UnProject( context.samples[ s ] );
+			}
+		}
+
+		for( int i = 0; i < numInputs; i++ )
+		{
+			if( !( channels & ( 1 << i ) ) )
+			{
+				continue;
+			}
+
+			std::vector<hdfValue> rawData = input[ i ]->Values( context.samples );
+			const hdfValue * sample = & rawData[ 0 ];
+
+			for( unsigned int c = 0; c < context.columns.size(); c++ )
+			{
+				// accumulate sample values, weighted by coverage
+				hdfValue val( 0, 0 );
+				for( int k = 0; k < numSamples; k++, sample++ )
 				{
-					hdfValue& val = output[ i ]( y, x );
-					if( val.y > 0 )
-						val = hdfValue( val.x / val.y, val.y * oneOverNumSamples );
-					else
-						val = hdfValue( 0, 0 );
+					val += hdfValue( sample->x * sample->y, sample->y );
 				}
+
+				// divide by number of samples
+				if( val.y > 0 )
+					val = hdfValue( val.x / val.y, val.y * oneOverNumSamples );
+				else
+					val = hdfValue( 0, 0 );
+				output[ i ]( y, context.columns[ c ] ) = val;
+			}
+		}
+	}
+}
+
+void hdfImage::UpdateMaskSpans()
+{
+	maskSpans.assign( Height(), std::vector< interval<int> >() );
+
+	std::list<hdfPolygon> mask;
+	for( unsigned int i = 0; i < input.size(); i++ )
+	{
+		std::list<hdfPolygon> inputMask = input[ i ]->GetMask();
+		mask.splice( mask.end(), inputMask );
+	}
+
+	if( mask.empty() )
+	{
+		for( int y = 0; y < Height(); y++ )
+		{
+			maskSpans[ y ].push_back( interval<int>( 0, Width() ) );
+		}
+		return;
+	}
+
+	// the polygons are indexed by line, each only visits the lines it covers
+	std::list<hdfPolygon> outlines = OutputProjector()->Project( mask );
+	for( std::list<hdfPolygon>::const_iterator outline = outlines.begin(); outline != outlines.end(); ++outline )
+	{
+		AddMaskSpans( imageRect.ConvertGlobal( viewRect.ConvertLocal( *outline ) ) );
+	}
+
+	// merge overlapping spans
+	for( int y = 0; y < Height(); y++ )
+	{
+		std::vector< interval<int> > & spans = maskSpans[ y ];
+		std::sort( spans.begin(), spans.end(), earlierSpan );
+
+		unsigned int merged = 0;
+		for( unsigned int k = 1; k < spans.size(); k++ )
+		{
+			if( spans[ k ].min <= spans[ merged ].max )
+			{
+				spans[ merged ].max = max( spans[ merged ].max, spans[ k ].max );
 			}
 			else
 			{
-				for( int i = 0; i < numInputs; i++ )
-				{
-					output[ i ]( y, x ) = hdfValue( 0, 0 );
-				}
+				spans[ ++merged ] = spans[ k ];
 			}
 		}
-		progressNotify( y, yMin, yMax );
+		spans.resize( min( ( unsigned int ) spans.size(), merged + 1 ) );
 	}
 }
 
+void hdfImage::AddMaskSpans( const hdfPolygon & outline )
+{
+	const int numVertices = outline.NumVertices();
+	if( numVertices == 0 )
+	{
+		return;
+	}
+
+	hdfScalar top = outline[ 0 ].y;
+	hdfScalar bottom = outline[ 0 ].y;
+	for( int v = 1; v < numVertices; v++ )
+	{
+		top = min( top, outline[ v ].y );
+		bottom = max( bottom, outline[ v ].y );
+	}
+
+	// skip outlines that failed to project or miss the image
+	if( !( top <= bottom ) || bottom < 0 || top >= Height() )
+	{
+		return;
+	}
+
+	const int yMin = max( int( floor( top ) ), 0 );
+	const int yMax = min( int( floor( bottom ) ), Height() - 1 );
+	for( int y = yMin; y <= yMax; y++ )
+	{
+		// find the columns touched by the edges within the line
+		hdfScalar left = std::numeric_limits<hdfScalar>::max();
+		hdfScalar right = -std::numeric_limits<hdfScalar>::max();
+		for( int v = 0; v < numVertices; v++ )
+		{
+			const hdfCoord & a = outline[ v ];
+			const hdfCoord & b = outline[ ( v + 1 ) % numVertices ];
+			if( max( a.y, b.y ) < y || min( a.y, b.y ) > y + 1 )
+			{
+				continue;
+			}
+
+			hdfScalar t0 = 0;
+			hdfScalar t1 = 1;
+			if( a.y != b.y )
+			{
+				t0 = clamp( ( y - a.y ) / ( b.y - a.y ), hdfScalar( 0 ), hdfScalar( 1 ) );
+				t1 = clamp( ( y + 1 - a.y ) / ( b.y - a.y ), hdfScalar( 0 ), hdfScalar( 1 ) );
+			}
+			const hdfScalar x0 = a.x + t0 * ( b.x - a.x );
+			const hdfScalar x1 = a.x + t1 * ( b.x - a.x );
+			left = min( left, min( x0, x1 ) );
+			right = max( right, max( x0, x1 ) );
+		}
+
+		const int first = int( floor( clamp( left, hdfScalar( 0 ), hdfScalar( Width() ) ) ) );
+		const int last = int( ceil( clamp( right, hdfScalar( 0 ), hdfScalar( Width() ) ) ) );
+		if( first < last )
+		{
+			maskSpans[ y ].push_back( interval<int>( first, last ) );
+		}
+	}
+}
+
+bool hdfImage::IsMasked( const intRect & tile ) const
+{
+	for( int y = tile.Top(); y < tile.Bottom(); y++ )
+	{
+		const std::vector< interval<int> > & spans = maskSpans[ y ];
+		for( unsigned int k = 0; k < spans.size(); k++ )
+		{
+			if( spans[ k ].min < tile.Right() && spans[ k ].max > tile.Left() )
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+hdfImage::sampleKey hdfImage::SampleKey( int channel ) const
+{
+	sampleKey key;
+	AddToSampleKey( input[ channel ], key );
+	key.outputProjector = outputProjector;
+	key.viewRect = viewRect;
+	key.width = Width();
+	key.height = Height();
+	key.overSampling = overSampling;
+	return key;
+}
+
+void hdfImage::AddToSampleKey( const ptr<hdfDataNode> & node, sampleKey & key )
+{
+	key.nodes.push_back( node );
+
+	const hdfDataSource * source = node->FindDataSource();
+	if( source == node.Ptr() )
+	{
+		key.fields.push_back( source->DataField() );
+		key.dimensions.push_back( source->Dimensions() );
+	}
+
+	for( int i = 0; i < node->NumInputs(); i++ )
+	{
+		AddToSampleKey( node->Input( i ), key );
+	}
+}
+
+bool hdfImage::sampleKey::operator == ( const sampleKey & other ) const
+{
+	return nodes == other.nodes && fields == other.fields && dimensions == other.dimensions
+		&& outputProjector == other.outputProjector && viewRect == other.viewRect
+		&& width == other.width && height == other.height && overSampling == other.overSampling;
+}
+
 void hdfImage::Colorize()
 {
 	Colorize( 0, 0, Width(), Height() );
@@ -388,43 +796,71 @@ void hdfImage::Colorize( const intRect & region )
 
 void hdfImage::Colorize( int xMin, int yMin, int xMax, int yMax )
 {
-	if( InputMode() == single )
-	{       
+	if( InputMode() == none || xMin >= xMax || yMin >= yMax ) return;
+
+	// get the pixels once, scanLine() detaches the image and is not thread safe
+	uchar * bits = outImage.bits();
+	const int bytesPerLine = outImage.bytesPerLine();
+	const int numTasks = std::min( ( yMax - yMin + s_colorize_lines - 1 ) / s_colorize_lines, renderPool.maxThreadCount() );
+	if( numTasks <= 1 )
+	{
 		for( int y = yMin ; y < yMax ; ++y )
 		{
-			for( int x = xMin ; x < xMax ; ++x )
-			{
-				outImage.setPixel( x, y, colorMap( output[ 0 ]( y, x ).x ).qRgb( convert( output[ 0 ]( y, x ).y, 0, 1 ) ) );
-			}
+			ColorizeLine( ( QRgb * ) ( bits + y * bytesPerLine ), y, xMin, xMax );
 		}
+		return;
 	}
-	else if( InputMode() == comparison )
-	{       
+
+	QAtomicInt nextLine( yMin );
+	for( int i = 0; i < numTasks; i++ )
+	{
+		renderPool.start( new colorizeTask( *this, intRect( xMin, yMin, xMax, yMax ), bits, bytesPerLine, nextLine ) );
+	}
+	renderPool.waitForDone();
+}
+
+void hdfImage::UpdateColorLookup()
+{
+	colorLookup.resize( s_color_lookup_size + 1 );
+	for( int i = 0; i <= s_color_lookup_size; i++ )
+	{
+		const float t = colorMap.DomainMin() + colorMap.DomainSize() * i / s_color_lookup_size;
+		colorLookup[ i ] = colorMap( t ).qRgb( 0 );
+	}
+}
+
+void hdfImage::ColorizeLine( QRgb * line, int y, int xMin, int xMax ) const
+{
+	if( InputMode() == single || InputMode() == comparison )
+	{
+		// map the color scale domain to the lookup table, NaN goes to the first entry
+		const hdfScalar lookupMin = colorMap.DomainMin();
+		const hdfScalar lookupScale = colorMap.DomainSize() > 0 ? s_color_lookup_size / colorMap.DomainSize() : 0;
+		const QRgb * lookup = & colorLookup[ 0 ];
+		const hdfValue * data0 = & output[ 0 ]( y, 0 );
+		const hdfValue * data1 = InputMode() == comparison ? & output[ 1 ]( y, 0 ) : 0;
 		hdfOpBinarySub diff;
 
-		for( int y = yMin ; y < yMax ; ++y )
+		for( int x = xMin ; x < xMax ; ++x )
 		{
-			for( int x = xMin ; x < xMax ; ++x )
-			{
-				hdfValue dataPixel = diff( output[ 0 ]( y, x ), output[ 1 ]( y, x ) );
-				outImage.setPixel( x, y, colorMap( dataPixel.x ).qRgb( convert( dataPixel.y, 0, 1 ) ) );
-			}
+			const hdfValue dataPixel = data1 ? diff( data0[ x ], data1[ x ] ) : data0[ x ];
+			const hdfScalar index = clamp( ( dataPixel.x - lookupMin ) * lookupScale + hdfScalar( 0.5 ), hdfScalar( 0 ), hdfScalar( s_color_lookup_size ) );
+			line[ x ] = lookup[ index >= 0 ? int( index ) : 0 ] | ( QRgb( convert( dataPixel.y, 0, 1 ) ) << 24 );
 		}
 	}
 	else if( InputMode() == rgb )
 	{
-		for( int y = yMin ; y < yMax ; ++y )
+		const hdfValue * data[ 3 ] = { & output[ 0 ]( y, 0 ), & output[ 1 ]( y, 0 ), & output[ 2 ]( y, 0 ) };
+
+		for( int x = xMin ; x < xMax ; ++x )
 		{
-			for( int x = xMin ; x < xMax ; ++x )
+			int c[ 4 ];
+			for( int i = 0; i < 3; i++ )
 			{
-				int c[ 4 ];
-				for( int i = 0; i < 3; i++ )
-				{
-					c[ i ] = convert( output[ i ]( y, x ).x, OutputMin(), OutputMax() );
-				}
-				c[ 3 ] = convert( min( output[ 0 ]( y, x ).y, output[ 1 ]( y, x ).y, output[ 2 ]( y, x ).y ), 0, 1 );
-				outImage.setPixel( x, y, qRgba( c[ 0 ], c[ 1 ], c[ 2 ], c[ 3 ] ) );
+				c[ i ] = convert( data[ i ][ x ].x, OutputMin(), OutputMax() );
 			}
+			c[ 3 ] = convert( min( data[ 0 ][ x ].y, data[ 1 ][ x ].y, data[ 2 ][ x ].y ), 0, 1 );
+			line[ x ] = qRgba( c[ 0 ], c[ 1 ], c[ 2 ], c[ 3 ] );
 		}
 	}
 }
@@ -451,10 +887,7 @@ void hdfImage::RenderLine( int y )
 				std::vector<hdfValue> values( Input( 0 )->Values( location ) );
 				std::copy( values.begin(), values.end(), output[ 0 ].at( y, 0 ) );
 
-				for( int x = 0 ; x < Width() ; ++x )
-				{
-					outImage.setPixel( x, y, colorMap( output[ 0 ]( y, x ).x ).qRgb( convert( output[ 0 ]( y, x ).y, 0, 1 ) ) );
-				}
+				ColorizeLine( ( QRgb * ) outImage.scanLine( y ), y, 0, Width() );
 			}
 		}
 		else if( InputMode() == comparison )
@@ -476,12 +909,7 @@ void hdfImage::RenderLine( int y )
 					std::copy( values.begin(), values.end(), output[ i ].at( y, 0 ) );
 				}
 
-				hdfOpBinarySub compare;
-				for( int x = 0 ; x < Width() ; ++x )
-				{
-					hdfValue dataPixel = compare( output[ 0 ]( y, x ), output[ 1 ]( y, x ) );
-					outImage.setPixel( x, y, colorMap( dataPixel.x ).qRgb( convert( dataPixel.y, 0, 1 ) ) );
-				}
+				ColorizeLine( ( QRgb * ) outImage.scanLine( y ), y, 0, Width() );
 			}
 		}
 		else if( InputMode() == rgb )
@@ -503,16 +931,7 @@ void hdfImage::RenderLine( int y )
 					std::copy( values.begin(), values.end(), output[ i ].at( y, 0 ) );
 				}
 
-				for( int x = 0 ; x < Width() ; ++x )
-				{
-					int c[ 4 ];
-					for( int i = 0; i < 3; i++ )
-					{
-						c[ i ] = convert( output[ i ]( y, x ).x, OutputMin(), OutputMax() );
-					}
-					c[ 3 ] = convert( min( output[ 0 ]( y, x ).y, output[ 1 ]( y, x ).y, output[ 2 ]( y, x ).y ), 0, 1 );
-					outImage.setPixel( x, y, qRgba( c[ 0 ], c[ 1 ], c[ 2 ], c[ 3 ] ) );
-				}
+				ColorizeLine( ( QRgb * ) outImage.scanLine( y ), y, 0, Width() );
 			}
 		}
 	}
@@ -3,6 +3,7 @@
 
 #include <qimage.h>
 #include <qpainterpath.h>
+#include <qthreadpool.h>
 
 #include "point.h"
 #include "rect.h"
@@ -13,6 +14,8 @@
 #include "colorScale.h"
 #include "matrix.h"
 
+class hdfFieldNode;
+
 enum borderType
 {
 	none = 0,
@@ -183,8 +186,20 @@ public:
 
 	//! Samples the inputs and updates output data for a rectangle in the image,
 	//! converting the output values to colors and updating the image.
+	//! The rectangle is split into tiles that are rendered by a pool of
+	//! threads, so the inputs must allow Values() to be called from several
+	//! threads at once. Projector calls are serialized by projectorMutex().
+	//! Tiles already sampled for the same inputs, orbit, view and image size
+	//! are kept, so changing only colors does not sample the data again.
+	//! Only pixels inside the masks of the inputs are sampled, the rest are
+	//! set to 0 with a coverage of 0.
 	void Render( int xMin, int yMin, int xMax, int yMax );
 
+	//! Forgets which tiles have been sampled, so the next Render() samples
+	//! every pixel again. Needed only if data changes without changing the
+	//! input tree, such as a file being rewritten.
+	void FlushSamples();
+
 	//! Converts output data values to colors and updates the image.
 	void Colorize();
 
@@ -242,6 +257,84 @@ protected:
 	//! \param max the last line number of the Render() call in progress
 	virtual void progressNotify( int value, int min, int max );
 
+	//! Scratch space used by one thread to render tiles.
+	struct renderContext
+	{
+		std::vector<int> columns; //!< pixels of the current line inside the mask
+		std::vector<hdfCoord> samples; //!< sample locations of the current line
+	};
+
+	//! A tile for Render() and the channels that must be sampled.
+	struct renderItem
+	{
+		intRect tile; //!< pixels to sample
+		unsigned int channels; //!< bit i is set if output i is sampled
+	};
+
+	//! Identifies the data sampled into an output matrix.
+	//! Holds on to the input tree and the fields it reads, so they cannot be
+	//! freed and replaced by different ones at the same address.
+	struct sampleKey
+	{
+		std::vector< ptr<hdfDataNode> > nodes; //!< nodes of the input tree, depth first
+		std::vector< ptr<hdfFieldNode> > fields; //!< field read by each data source in the tree
+		std::vector< std::vector<int> > dimensions; //!< visible slice of each data source in the tree
+		ptr<projector> outputProjector; //!< map projection of the image
+		hdfRect viewRect; //!< viewable rectangle
+		int width; //!< image width
+		int height; //!< image height
+		int overSampling; //!< samples per pixel per axis
+
+		//! Creates a key that matches no samples.
+		sampleKey() : width( 0 ), height( 0 ), overSampling( 0 ) {}
+
+		//! Returns true if both keys describe the same samples.
+		bool operator == ( const sampleKey & other ) const;
+	};
+
+	//! Tiles of an output matrix that hold sampled data.
+	struct sampleCache
+	{
+		sampleKey key; //!< the data sampled
+		matrix<unsigned char> tiles; //!< nonzero for tiles of s_render_tile_size pixels that have been sampled
+	};
+
+	class renderTask;
+	class colorizeTask;
+
+	//! Samples the inputs and updates output data for a tile of the image.
+	//! Tiles that do not overlap can be rendered at the same time.
+	//! \param channels bit i is set if output i is sampled
+	void RenderTile( const intRect & tile, unsigned int channels, renderContext & context );
+
+	//! Rebuilds maskSpans from the masks of all inputs.
+	//! If no input has a mask, every pixel is covered.
+	void UpdateMaskSpans();
+
+	//! Adds the pixels touched by a polygon in image coordinates to maskSpans.
+	void AddMaskSpans( const hdfPolygon & outline );
+
+	//! Remembers the tiles of an item for the outputs it sampled.
+	//! Tiles only partly inside the image region of the Render() call are not kept.
+	void MarkSampled( const renderItem & item );
+
+	//! Returns true if any pixel of a tile is in maskSpans.
+	bool IsMasked( const intRect & tile ) const;
+
+	//! Returns the key of the data currently sampled by an input.
+	sampleKey SampleKey( int channel ) const;
+
+	//! Adds a node and its inputs to a sample key.
+	static void AddToSampleKey( const ptr<hdfDataNode> & node, sampleKey & key );
+
+	//! Rebuilds colorLookup from colorMap.
+	void UpdateColorLookup();
+
+	//! Converts output data values of part of a line to colors.
+	//! Lines that differ can be colorized at the same time.
+	//! \param line the first pixel of the line in the image
+	void ColorizeLine( QRgb * line, int y, int xMin, int xMax ) const;
+
 	ptr<projector> outputProjector; //!< map projection used in output image
 
 	std::vector< ptr< hdfDataNode > > input; //!< list of data inputs
@@ -251,6 +344,7 @@ protected:
 	hdfScalar outputMax; //!< maximum value for data to RGB conversion
 
 	colorScale colorMap; //!< color map for single channel data to color conversion
+	std::vector<QRgb> colorLookup; //!< colorMap sampled evenly over its domain, without alpha
 
 	QImage outImage; //!< displays data in color and coastlines
 
@@ -259,6 +353,10 @@ protected:
 	hdfRect imageRect; //!< image area in pixels
 	
 	int overSampling; //!< number of samples per pixel per axis
+
+	QThreadPool renderPool; //!< threads used by Render()
+	std::vector<sampleCache> samples; //!< tiles of each output sampled by Render()
+	std::vector< std::vector< interval<int> > > maskSpans; //!< sorted columns min to max - 1 of each line covered by the input masks
 	
 	QPainterPath boundariesPath[3]; //!< path containing all coastlines in a category
 	projector* boundaryProjector[3]; //!< projection that the cached coastlines are currently stored in
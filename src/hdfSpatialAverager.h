@@ -1,13 +1,293 @@
 #ifndef HDFSPATIALAVERAGER_H_INCLUDED
 #define HDFSPATIALAVERAGER_H_INCLUDED
 
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <qmutex.h>
 
 #include "ptr.h"
 #include "hdfDataNode.h"
+#include "hdfDataSource.h"
+
+//! Summed-area tables of the samples taken around one block of a field.
+//! The block's pixel grid is extended by the sampling radius on all sides and
+//! every pixel center is sampled once, as one tile of the input. The tables are
+//! strided by the sample spacing, so the sums over the sampling box of any pixel
+//! of the block take four lookups whatever the radius. Values are shifted by
+//! the first covered sample to keep the sums of squares precise.
+class hdfBoxSums
+{
+public:
+
+	//! Sets up the tables for a block, call Sample() to fill them.
+	//! \param theField the field whose pixel grid is sampled
+	//! \param theBlock the block index
+	//! \param theRadius the sampling radius in samples
+	//! \param theStepX the spacing between samples in pixels in x
+	//! \param theStepY the spacing between samples in pixels in y
+	//! \param withSquares also sum the squares of the values
+    hdfBoxSums( const hdfField & theField, int theBlock, int theRadius, int theStepX, int theStepY, bool withSquares )
+    :
+    block( theBlock ),
+    blockRect( theField->BlockRect( theBlock ) ),
+    xDim( theField->XDim() ),
+    yDim( theField->YDim() ),
+    radius( theRadius ),
+    stepX( theStepX ),
+    stepY( theStepY ),
+    haloX( theRadius * theStepX ),
+    haloY( theRadius * theStepY ),
+    width( xDim + 2 * haloX ),
+    height( yDim + 2 * haloY ),
+    sums( width * height ),
+    squares( withSquares ? width * height : 0 ),
+    offset( 0 ),
+    aligned( IsAligned( theField ) )
+    {
+
+    }
+
+	//! Samples an input at every pixel center of the extended block as one tile and builds the tables.
+    void Sample( hdfDataNode & input )
+    {
+        hdfTile extended( block, blockRect, xDim, yDim );
+        extended.xMin = -haloX;
+        extended.yMin = -haloY;
+        extended.width = width;
+        extended.height = height;
+
+        input.Tile( extended, & sums[ 0 ], height );
+
+        bool offsetFound = false;
+
+        for ( unsigned int k = 0 ; k < sums.size() ; ++k )
+        {
+            const hdfScalar coverage = sums[ k ].y;
+
+            if ( coverage == 0 )
+            {
+                sums[ k ] = hdfValue( 0, 0 );
+                if ( ! squares.empty() ) squares[ k ] = 0;
+                continue;
+            }
+
+            if ( ! offsetFound )
+            {
+                offset = sums[ k ].x;
+                offsetFound = true;
+            }
+
+            const hdfScalar difference = sums[ k ].x - offset;
+            sums[ k ] = hdfValue( coverage * difference, coverage );
+            if ( ! squares.empty() ) squares[ k ] = coverage * difference * difference;
+        }
+
+        Integrate( sums );
+        Integrate( squares );
+    }
+
+	//! Finds the pixel of the block that holds a location.
+	//! Returns false if the location is outside the block, or if its sampling box
+	//! reaches into a neighboring block whose pixels are not aligned with this one.
+	//! \param location a location in the field's native projection
+	//! \param i set to the pixel in x
+	//! \param j set to the pixel in y
+    bool Find( const hdfCoord & location, int & i, int & j ) const
+    {
+        const hdfScalar x = ( location.x - blockRect.Left() ) / blockRect.Width();
+        const hdfScalar y = ( location.y - blockRect.Top() ) / blockRect.Height();
+
+        if ( x < 0 || x >= 1 || y < 0 || y >= 1 )
+        {
+            return false;
+        }
+
+        i = int( xDim * x );
+        j = int( yDim * y );
+
+        return aligned || ( i >= haloX && i + haloX < xDim && j >= haloY && j + haloY < yDim );
+    }
+
+	//! Returns the sums over the sampling box of pixel ( i, j ) of the block.
+	//! \param i pixel in x
+	//! \param j pixel in y
+	//! \param sum the sum of coverage * ( value - Offset() )
+	//! \param sumSquares the sum of coverage * ( value - Offset() )^2, 0 if the squares are not summed
+	//! \param count the sum of coverage
+    void Sums( int i, int j, hdfScalar & sum, hdfScalar & sumSquares, hdfScalar & count ) const
+    {
+        const int x1 = i + 2 * haloX;
+        const int y1 = j + 2 * haloY;
+        const int x0 = i - stepX;
+        const int y0 = j - stepY;
+
+        hdfValue box = Lookup( sums, x1, y1 ) - Lookup( sums, x0, y1 )
+            - Lookup( sums, x1, y0 ) + Lookup( sums, x0, y0 );
+
+        sum = box.x;
+        count = box.y;
+        sumSquares = 0;
+
+        if ( ! squares.empty() )
+        {
+            sumSquares = max( Lookup( squares, x1, y1 ) - Lookup( squares, x0, y1 )
+                - Lookup( squares, x1, y0 ) + Lookup( squares, x0, y0 ), hdfScalar( 0 ) );
+        }
+    }
+
+	//! Returns the value all sums are relative to.
+    hdfScalar Offset() const
+    {
+        return offset;
+    }
+
+	//! Returns the number of samples in each sampling box.
+    int Samples() const
+    {
+        return square( 2 * radius + 1 );
+    }
+
+	//! Returns the memory used by the tables.
+    size_t Bytes() const
+    {
+        return sums.size() * sizeof( hdfValue ) + squares.size() * sizeof( hdfScalar );
+    }
+
+	//! Returns the block of a field holding a location, or -1 if no block holds it.
+	//! Finds the block the same way hdfDataSource samples it.
+    static int Block( const hdfField & field, const hdfCoord & location )
+    {
+        const int blockIndex = Column( field, location.x );
+
+        if ( blockIndex < field->StartBlock() || blockIndex > field->EndBlock() )
+        {
+            return -1;
+        }
+
+        const hdfRect & rect = field->BlockRect( blockIndex );
+        const hdfScalar y = ( location.y - rect.Top() ) / rect.Height();
+
+        return ( y >= 0 && y < 1 ) ? blockIndex : -1;
+    }
+
+	//! Returns the number of pixels between samples, or false if the spacing is not a whole number of pixels.
+    static bool Steps( const hdfField & field, int blockIndex, hdfScalar spacing, int & theStepX, int & theStepY )
+    {
+        const hdfRect & rect = field->BlockRect( blockIndex );
+        const hdfScalar pixelX = fabs( rect.Width() ) / field->XDim();
+        const hdfScalar pixelY = fabs( rect.Height() ) / field->YDim();
+
+        if ( pixelX <= 0 || pixelY <= 0 )
+        {
+            return false;
+        }
+
+        theStepX = int( floor( spacing / pixelX + 0.5 ) );
+        theStepY = int( floor( spacing / pixelY + 0.5 ) );
+
+        return theStepX > 0 && theStepY > 0
+            && fabs( theStepX * pixelX - spacing ) <= 1e-6 * spacing
+            && fabs( theStepY * pixelY - spacing ) <= 1e-6 * spacing;
+    }
+
+protected:
+
+	//! Returns the center of pixel ( i, j ) of the block's grid, which may lie outside the block.
+    hdfCoord PixelCenter( int i, int j ) const
+    {
+        return blockRect.ConvertGlobal( hdfCoord( ( i + 0.5 ) / xDim, ( j + 0.5 ) / yDim ) );
+    }
+
+	//! Returns the block index whose column of the field holds x, which may be outside the field's blocks.
+    static int Column( const hdfField & field, hdfScalar x )
+    {
+        const hdfRect & first = field->BlockRect( field->StartBlock() );
+        return field->StartBlock() + int( ( x - first.Left() ) / fabs( first.Width() ) );
+    }
+
+	//! Returns true if every block the halo reaches has its pixels on this block's grid.
+	//! Samples of those blocks then stay constant over the pixels of the tables.
+    bool IsAligned( const hdfField & field ) const
+    {
+        const int first = max( Column( field, PixelCenter( -haloX, 0 ).x ), field->StartBlock() );
+        const int last = min( Column( field, PixelCenter( width - haloX - 1, 0 ).x ), field->EndBlock() );
+
+        for ( int index = first ; index <= last ; ++index )
+        {
+            const hdfRect & rect = field->BlockRect( index );
+            const hdfScalar x = ( rect.Left() - blockRect.Left() ) * xDim / blockRect.Width();
+            const hdfScalar y = ( rect.Top() - blockRect.Top() ) * yDim / blockRect.Height();
+
+            if ( fabs( rect.Width() - blockRect.Width() ) > 1e-6 * fabs( blockRect.Width() )
+                || fabs( rect.Height() - blockRect.Height() ) > 1e-6 * fabs( blockRect.Height() )
+                || fabs( x - floor( x + 0.5 ) ) > 1e-6 || fabs( y - floor( y + 0.5 ) ) > 1e-6 )
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+	//! Turns a table of samples into sums over all samples at whole steps before and above each sample.
+    template<class valueType>
+    void Integrate( std::vector<valueType> & table ) const
+    {
+        if ( table.empty() )
+        {
+            return;
+        }
+
+        for ( int i = 0 ; i < width ; ++i )
+        {
+            for ( int j = stepY ; j < height ; ++j )
+            {
+                table[ i * height + j ] += table[ i * height + j - stepY ];
+            }
+        }
+
+        for ( int k = stepX * height ; k < width * height ; ++k )
+        {
+            table[ k ] += table[ k - stepX * height ];
+        }
+    }
+
+	//! Returns an entry of a table for pixel ( i - haloX, j - haloY ), or zero before the start of the table.
+    template<class valueType>
+    valueType Lookup( const std::vector<valueType> & table, int i, int j ) const
+    {
+        if ( i < 0 || j < 0 )
+        {
+            return valueType();
+        }
+
+        return table[ i * height + j ];
+    }
+
+    const int block; //!< block index
+    const hdfRect blockRect; //!< bounding rectangle of the block in native projection
+    const int xDim; //!< pixels across the block in x
+    const int yDim; //!< pixels across the block in y
+    const int radius; //!< sampling radius in samples
+    const int stepX; //!< pixels between samples in x
+    const int stepY; //!< pixels between samples in y
+    const int haloX; //!< pixels sampled past the block edges in x
+    const int haloY; //!< pixels sampled past the block edges in y
+    const int width; //!< pixels of the tables in x
+    const int height; //!< pixels of the tables in y
+    std::vector<hdfValue> sums; //!< summed coverage * value and coverage
+    std::vector<hdfScalar> squares; //!< summed coverage * value^2
+    hdfScalar offset; //!< the value all sums are relative to
+    const bool aligned; //!< true if the whole halo is on the block's grid
+};
 
 //! A data node that computes the spatial average of an input.
 //! Computes the mean of all samples within a specified radius.
+//! When the input is a data source and the spacing is a whole number of its
+//! pixels, blocks that are sampled often get summed-area tables, and their
+//! averages take a constant time whatever the radius.
+//! \see hdfBoxSums
 //! \todo Specify radius in meters, automatically figure out how many samples to take, and sample in a circle instead of a box.
 class hdfSpatialAverager : public hdfDataNode
 {
@@ -21,7 +301,9 @@ public:
     :
     hdfDataNode( 1 ),
     radius( theRadius ),
-    spacing( theSpacing )
+    spacing( theSpacing ),
+    tableBytes( 0 ),
+    uses( 0 )
     {
         setInput( 0, input );
     }
@@ -32,9 +314,79 @@ public:
 
     }
 
-	//! Returns the standard deviation of the input sampled in a box around the requested location.
+	//! Drops the tables of the previous orbit.
+    virtual void setOrbit( int orbit )
+    {
+        hdfDataNode::setOrbit( orbit );
+
+        QMutexLocker locker( &blocksLock );
+        blocks.clear();
+        tableBytes = 0;
+    }
+
+	//! Returns the spatial average of the input sampled in a box around the requested location.
 	//! The total number of samples is ( 2 * radius + 1 ) * ( 2 * radius + 1 ).
     virtual hdfValue Value( const hdfCoord & location )
+    {
+        const hdfField field = Grid();
+        int i, j;
+
+        if ( field.IsValid() )
+        {
+            ptr<hdfBoxSums> tables = Tables( field, hdfBoxSums::Block( field, location ), 1 );
+
+            if ( tables.IsValid() && tables->Find( location, i, j ) )
+            {
+                return BoxValue( *tables, i, j );
+            }
+        }
+
+        return PointValue( location );
+    }
+
+	//! Same as Value(), but samples many points at once.
+	//! Looks up the tables once for each run of points in the same block.
+    virtual std::vector<hdfValue> Values( const std::vector<hdfCoord> & location )
+    {
+        const hdfField field = Grid();
+        std::vector<hdfValue> output( location.size() );
+        unsigned int first = 0;
+
+        while ( first < location.size() )
+        {
+            const int blockIndex = field.IsValid() ? hdfBoxSums::Block( field, location[ first ] ) : -1;
+            unsigned int last = first + 1;
+
+            while ( last < location.size() && field.IsValid() && hdfBoxSums::Block( field, location[ last ] ) == blockIndex )
+            {
+                ++last;
+            }
+
+            ptr<hdfBoxSums> tables = field.IsValid() ? Tables( field, blockIndex, last - first ) : ptr<hdfBoxSums>();
+            int i, j;
+
+            for ( unsigned int k = first ; k < last ; ++k )
+            {
+                if ( tables.IsValid() && tables->Find( location[ k ], i, j ) )
+                {
+                    output[ k ] = BoxValue( *tables, i, j );
+                }
+                else
+                {
+                    output[ k ] = PointValue( location[ k ] );
+                }
+            }
+
+            first = last;
+        }
+
+        return output;
+    }
+
+protected:
+
+	//! Returns the average in a box around a location, sampling every point of the box.
+    virtual hdfValue PointValue( const hdfCoord & location )
     {
         hdfValue mean( 0, 0 );
 
@@ -58,10 +410,138 @@ public:
         }
     }
 
-protected:
+	//! Returns the average for pixel ( i, j ) of a block from its tables.
+    virtual hdfValue BoxValue( const hdfBoxSums & box, int i, int j ) const
+    {
+        hdfScalar sum, sumSquares, count;
+        box.Sums( i, j, sum, sumSquares, count );
+
+        // summed coverage below this is rounding error of the tables
+        if ( count > 1e-9 )
+        {
+            return hdfValue( sum / count + box.Offset(), count / box.Samples() );
+        }
+        else
+        {
+            return hdfValue( 0, 0 );
+        }
+    }
+
+	//! Returns true if the tables must also sum the squares of the values.
+    virtual bool NeedsSquares() const
+    {
+        return false;
+    }
+
+	//! Returns the field whose pixels the input is constant over, or an invalid field.
+	//! Only a data source input is known to be, which is how nodeMaker builds averages.
+    hdfField Grid() const
+    {
+        const hdfDataSource * source = Input( 0 )->FindDataSource();
+
+        if ( source == 0 || source != Input( 0 ).Ptr() || !source->Check() )
+        {
+            return hdfField();
+        }
+
+        return source->DataField();
+    }
+
+	//! Returns the tables of a block for points about to be sampled in it, or an invalid pointer.
+	//! A block gets tables once the points sampled in it would have taken as
+	//! many samples as building them, so blocks that are only sampled a few
+	//! times are never built. The least recently used tables are dropped past
+	//! tableBudget bytes.
+	//! \param field the field the tables are built on
+	//! \param blockIndex the block, or -1 for points outside all blocks
+	//! \param points the number of points about to be sampled
+    ptr<hdfBoxSums> Tables( const hdfField & field, int blockIndex, int points )
+    {
+        int stepX, stepY;
+
+        if ( blockIndex < 0 || !hdfBoxSums::Steps( field, blockIndex, spacing, stepX, stepY ) )
+        {
+            return ptr<hdfBoxSums>();
+        }
+
+        {
+            QMutexLocker locker( &blocksLock );
+            blockTables & entry = blocks[ blockIndex ];
+
+            entry.lastUse = ++uses;
+
+            if ( entry.tables.IsValid() )
+            {
+                return entry.tables;
+            }
+
+            entry.samples += hdfScalar( points ) * square( 2 * radius + 1 );
+
+            const hdfScalar size = hdfScalar( field->XDim() + 2 * radius * stepX ) * ( field->YDim() + 2 * radius * stepY );
+
+            if ( entry.samples < size )
+            {
+                return ptr<hdfBoxSums>();
+            }
+        }
+
+        // build outside the lock so other blocks are not held up, another
+        // thread building the same block at the same time keeps its own copy
+        ptr<hdfBoxSums> tables = new hdfBoxSums( field, blockIndex, radius, stepX, stepY, NeedsSquares() );
+        tables->Sample( *Input( 0 ) );
+
+        QMutexLocker locker( &blocksLock );
+        blockTables & entry = blocks[ blockIndex ];
+
+        if ( entry.tables.IsNull() )
+        {
+            entry.tables = tables;
+            tableBytes += tables->Bytes();
+
+            while ( tableBytes > tableBudget )
+            {
+                std::map<int, blockTables>::iterator oldest = blocks.end();
+
+                for ( std::map<int, blockTables>::iterator it = blocks.begin() ; it != blocks.end() ; ++it )
+                {
+                    if ( it->first != blockIndex && it->second.tables.IsValid()
+                        && ( oldest == blocks.end() || it->second.lastUse < oldest->second.lastUse ) )
+                    {
+                        oldest = it;
+                    }
+                }
+
+                if ( oldest == blocks.end() )
+                {
+                    break;
+                }
+
+                tableBytes -= oldest->second.tables->Bytes();
+                oldest->second.tables = ptr<hdfBoxSums>();
+            }
+        }
+
+        return entry.tables;
+    }
+
+	//! Tables of one block and the use made of it.
+    struct blockTables
+    {
+        blockTables() : tables(), samples( 0 ), lastUse( 0 ) {}
+
+        ptr<hdfBoxSums> tables; //!< the tables, invalid until built
+        hdfScalar samples; //!< samples taken point by point in the block
+        unsigned long lastUse; //!< value of uses when last looked up
+    };
+
+    static const size_t tableBudget = 64 * 1024 * 1024; //!< memory for tables of all blocks
 
     const int radius; //!< sampling radius in pixels
     const hdfScalar spacing; //!< size of sample pixels
+    std::map<int, blockTables> blocks; //!< tables by block index
+    size_t tableBytes; //!< memory used by the tables in blocks
+    unsigned long uses; //!< number of table lookups
+    QMutex blocksLock; //!< guards blocks, tableBytes and uses
 };
 
 #endif // HDFSPATIALAVERAGER_H_INCLUDED
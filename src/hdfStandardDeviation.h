@@ -28,11 +28,13 @@ public:
 
     }
 
+protected:
+
 	//! Returns the standard deviation of the input sampled in a box around the requested location.
 	//! The total number of samples is ( 2 * radius + 1 ) * ( 2 * radius + 1 ).
-    virtual hdfValue Value( const hdfCoord & location )
+    virtual hdfValue PointValue( const hdfCoord & location )
     {
-        hdfValue mean = hdfSpatialAverager::Value( location );
+        hdfValue mean = hdfSpatialAverager::PointValue( location );
         hdfValue sum( 0, 0 );
         for ( int y = -radius ; y <= radius ; ++y )
         {
@@ -47,6 +49,28 @@ public:
         if ( sum.y <= 1 ) return hdfValue( 0, mean.y );
         return hdfValue( sqrt( sum.x / ( sum.y - 1 ) ), mean.y );
     }
+
+	//! Returns the standard deviation for pixel ( i, j ) of a block from its tables.
+	//! The sum of squared differences from the mean is sumSquares - sum^2 / count.
+    virtual hdfValue BoxValue( const hdfBoxSums & box, int i, int j ) const
+    {
+        hdfScalar sum, sumSquares, count;
+        box.Sums( i, j, sum, sumSquares, count );
+
+        if ( count <= 1e-9 ) return hdfValue( 0, 0 );
+
+        const hdfScalar coverage = count / box.Samples();
+        if ( count <= 1 ) return hdfValue( 0, coverage );
+
+        const hdfScalar deviation = max( sumSquares - sum * sum / count, hdfScalar( 0 ) );
+        return hdfValue( sqrt( deviation / ( count - 1 ) ), coverage );
+    }
+
+	//! The tables sum the squares of the values.
+    virtual bool NeedsSquares() const
+    {
+        return true;
+    }
 };
 
 #endif // HDFSTANDARDDEVIATION_H_INCLUDED
@@ -0,0 +1,80 @@
+#ifndef HDFTILE_H_INCLUDED
+#define HDFTILE_H_INCLUDED
+
+#include "hdfBase.h"
+
+//! A rectangle of pixels in the native grid of a block.
+//! The grid splits the block into xDim by yDim pixels, the same way a field
+//! with those dimensions stores the block. A tile may reach past the block
+//! edges, onto the same grid extended. Tiles are evaluated at pixel centers
+//! and stored x-major like field data: value ( xMin + i, yMin + j ) of a tile
+//! is at output[ i * stride + j ].
+class hdfTile
+{
+public:
+
+	//! Constructs an empty tile.
+	hdfTile()
+	:
+	block( 0 ),
+	blockRect(),
+	xDim( 0 ),
+	yDim( 0 ),
+	xMin( 0 ),
+	yMin( 0 ),
+	width( 0 ),
+	height( 0 )
+	{
+
+	}
+
+	//! Constructs a tile covering a whole block.
+	//! \param theBlock the block index
+	//! \param theBlockRect the bounding rectangle of the block in native projection
+	//! \param theXDim pixels across the block in x
+	//! \param theYDim pixels across the block in y
+	hdfTile( int theBlock, const hdfRect & theBlockRect, int theXDim, int theYDim )
+	:
+	block( theBlock ),
+	blockRect( theBlockRect ),
+	xDim( theXDim ),
+	yDim( theYDim ),
+	xMin( 0 ),
+	yMin( 0 ),
+	width( theXDim ),
+	height( theYDim )
+	{
+
+	}
+
+	//! Returns the number of pixels in the tile.
+	int Size() const
+	{
+		return width * height;
+	}
+
+	//! Returns the center of a pixel of the tile in native projection.
+	//! \param i pixel offset from xMin
+	//! \param j pixel offset from yMin
+	hdfCoord Location( int i, int j ) const
+	{
+		return blockRect.ConvertGlobal( hdfCoord( ( xMin + i + 0.5 ) / xDim, ( yMin + j + 0.5 ) / yDim ) );
+	}
+
+	//! Returns true if the tile lies on the pixel grid of a block of a field with the given dimensions.
+	bool IsOnGrid( const hdfRect & theBlockRect, int theXDim, int theYDim ) const
+	{
+		return blockRect == theBlockRect && xDim == theXDim && yDim == theYDim;
+	}
+
+	int block; //!< block index
+	hdfRect blockRect; //!< bounding rectangle of the block in native projection
+	int xDim; //!< pixels across the block in x
+	int yDim; //!< pixels across the block in y
+	int xMin; //!< first pixel of the tile in x
+	int yMin; //!< first pixel of the tile in y
+	int width; //!< number of pixels of the tile in x
+	int height; //!< number of pixels of the tile in y
+};
+
+#endif // HDFTILE_H_INCLUDED
@@ -1,18 +1,29 @@
 #ifndef PTR_H_INCLUDED
 #define PTR_H_INCLUDED
 
-#include <map>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+//! Shared reference count of the data behind one or more smart pointers.
+struct ptrCount
+{
+	std::atomic<int> count; //!< number of smart pointers sharing the data
+	const void * address; //!< address the count is registered under
+};
+
 
 //! Implements common functionality for all types of smart pointers.
-//! Since the smart pointer is a template object, each instantiation
-//! would have its own static variable if the pointer lookup table
-//! was placed in the template class. ptrBase avoids this problem by
-//! placing the lookup table in a common base class.
+//! Smart pointers copied from each other share a ptrCount directly, so
+//! copies and destruction only touch an atomic counter. Smart pointers
+//! constructed from standard pointers find the count of an address in a
+//! lookup table, which is kept in this common base class so that all
+//! template instantiations share it.
 class ptrBase
 {
 public:
 
-	typedef std::map< const void *, int > ptrMapType;
+	typedef std::unordered_map< const void *, ptrCount * > ptrMapType;
 
 	//! Returns pointer lookup table.
 	//! Stored as a static local so it is created on demand.
@@ -21,6 +32,68 @@ public:
 		static ptrMapType ptrMap;
 		return ptrMap;
 	}
+
+	//! Returns the lock guarding the pointer lookup table.
+	static std::mutex & PointerLock()
+	{
+		static std::mutex ptrLock;
+		return ptrLock;
+	}
+
+protected:
+
+	//! Returns the count registered for address with one more reference.
+	//! Creates a count if the address has none. Returns 0 for null.
+	static ptrCount * Adopt( const void * address )
+	{
+		if ( ! address ) return 0;
+
+		std::lock_guard<std::mutex> guard( PointerLock() );
+
+		ptrCount * & counter = PointerTable()[ address ];
+
+		if ( ! counter )
+		{
+			counter = new ptrCount;
+			counter->count = 0;
+			counter->address = address;
+		}
+
+		++counter->count;
+
+		return counter;
+	}
+
+	//! Adds a reference to a count already referenced by the caller.
+	static void Share( ptrCount * counter )
+	{
+		if ( counter ) ++counter->count;
+	}
+
+	//! Removes a reference from a count.
+	//! Returns true if it was the last one and the data must be freed.
+	static bool Release( ptrCount * counter )
+	{
+		if ( ! counter ) return false;
+
+		// drop references without locking while others remain
+		int count = counter->count;
+		while ( count > 1 )
+		{
+			if ( counter->count.compare_exchange_weak( count, count - 1 ) ) return false;
+		}
+
+		// the last reference is dropped under the lock so that Adopt()
+		// cannot hand out the count while it is being removed
+		std::lock_guard<std::mutex> guard( PointerLock() );
+
+		if ( --counter->count > 0 ) return false;
+
+		PointerTable().erase( counter->address );
+		delete counter;
+
+		return true;
+	}
 };
 
 
@@ -35,21 +108,23 @@ public:
 template<class dataType>
 	class ptr : private ptrBase
 {
+	template<class otherType> friend class ptr;
 
 public:
 
 	//! Constructs a new smart pointer from a standard pointer.
-	//! Creates shared reference counter with initial value 1.
-	ptr( dataType * init = 0 ) : ptrBase(), data( init )
+	//! Shares the reference count of smart pointers already owning init,
+	//! otherwise creates one with initial value 1.
+	ptr( dataType * init = 0 ) : ptrBase(), data( init ), counter( Adopt( init ) )
 	{
-		attach( init );
+
 	}
 
 	//! Creates a new smart pointer from an existing smart pointer.
 	//! Maintains reference count and ownership.
-	ptr( const ptr & other ) : ptrBase()
+	ptr( const ptr & other ) : ptrBase(), data( 0 ), counter( 0 )
 	{
-		attach( other.data );
+		attach( other.data, other.counter );
 	}
 
 	//! Assigns one smart pointer to another.
@@ -58,8 +133,15 @@ public:
 	{
 		if ( this != & other )
 		{
+			// share first in case other is only kept alive by this
+			dataType * otherData = other.data;
+			ptrCount * otherCounter = other.counter;
+
+			Share( otherCounter );
 			detach();
-			attach( other.data );
+
+			data = otherData;
+			counter = otherCounter;
 		}
 
 		return( *this );
@@ -75,10 +157,13 @@ public:
 	//! Converts a smart pointer to a smart pointer of a different type.
 	//! Works for any two compatible pointer types.
 	//! Allows conversion along an inheritance heirarchy.
+	//! The converted smart pointer shares the reference count.
 	template<typename otherType>
 		operator ptr<otherType>() const
 	{
-		return( ptr<otherType>( ( otherType * ) data ) );
+		ptr<otherType> converted;
+		converted.attach( ( otherType * ) data, counter );
+		return( converted );
 	}
 
 	//! Returns true if two smart pointers have the same memory address.
@@ -118,9 +203,10 @@ public:
 	}
 
 	//! Returns the number of smart pointers referencing the shared data.
+	//! Returns 0 for null.
 	int Count() const
 	{
-		return( refCount() );
+		return( counter ? int( counter->count ) : 0 );
 	}
 
 	//! Smart pointer dereference.
@@ -138,52 +224,29 @@ public:
 protected:
 
 	dataType * data; //!< encapsulated standard pointer
-
-	//! Returns a reference to the smart pointer's reference count.
-	//! Creates a counter set to 0 if one does not exist.
-	int & refCount() const
-	{
-		// search for pointer in lookup table
-		ptrMapType::iterator ptrMatch = PointerTable().find( ( const void * ) data );
-
-		// if no pointer has this address
-		if ( ptrMatch == PointerTable().end() )
-		{
-			// create entry, set count to 0
-			ptrMatch = PointerTable().insert( std::make_pair( ( const void * ) data, 0 ) ).first;
-		}
-
-		// return reference to count
-		return (*ptrMatch).second;
-	}
+	ptrCount * counter; //!< reference count shared with other smart pointers, null for null data
 
 	//! Smart pointer shares data with other.
-	void attach( dataType * other )
+	void attach( dataType * otherData, ptrCount * otherCounter )
 	{
-		data = other;
-		++refCount();
+		data = otherData;
+		counter = otherCounter;
+		Share( counter );
 	}
 
 	//! Smart pointer stops sharing data.
 	//! Frees memory if no longer referenced.
 	void detach()
 	{
-		if ( refCount() > 1 )
+		if ( Release( counter ) )
 		{
-			// decrement shared reference count
-			--refCount();
-		}
-		else
-		{
-			// remove from pointer lookup table
-			PointerTable().erase( ( const void * ) data );
-
 			// free memory if last reference
-			if ( data ) delete data;
+			delete data;
 		}
 
 		// prevent accidental use of old data
 		data = 0;
+		counter = 0;
 	}
 };
 
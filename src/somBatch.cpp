@@ -0,0 +1,340 @@
+#include "somBatch.h"
+#include <cmath>
+#include <limits>
+
+#include "hdfBase.h"
+
+//! ratio of the landsat orbit that starts at the beginning of a path
+static const double s_landsat_ratio = 0.5201613;
+
+//! WGS 84 axes, used when the parameters do not give the spheroid
+static const double s_wgs84_major = 6378137.0;
+static const double s_wgs84_minor = 6356752.314245;
+
+somBatch::somBatch( const std::vector<double>& parameters )
+:
+start( 0 )
+{
+	std::vector<double> parm( parameters );
+	parm.resize( 15, 0.0 );
+
+	// axes as in gctp's sphdz()
+	double rMajor = fabs( parm[ 0 ] );
+	double rMinor = fabs( parm[ 1 ] );
+	if ( rMajor <= 0 )
+	{
+		rMajor = s_wgs84_major;
+		rMinor = s_wgs84_minor;
+	}
+	else if ( rMinor <= 0 )
+	{
+		rMinor = rMajor;
+	}
+	else if ( rMinor <= 1 )
+	{
+		rMinor = sqrt( 1.0 - rMinor ) * rMajor;
+	}
+
+	falseEasting = parm[ 6 ];
+	falseNorthing = parm[ 7 ];
+	a = rMajor;
+	es = 1.0 - ( rMinor / rMajor ) * ( rMinor / rMajor );
+
+	double alf;
+	if ( parm[ 12 ] == 0 )
+	{
+		alf = UnpackAngle( parm[ 3 ] );
+		lonCenter = UnpackAngle( parm[ 4 ] );
+		p21 = parm[ 8 ] / 1440.0;
+		start = parm[ 10 ];
+	}
+	else
+	{
+		const long satnum = long( parm[ 2 ] );
+		const long path = long( parm[ 3 ] );
+		const double d2r = pi / 180.0;
+		if ( satnum < 4 )
+		{
+			alf = 99.092 * d2r;
+			p21 = 103.2669323 / 1440.0;
+			lonCenter = ( 128.87 - ( 360.0 / 251.0 * path ) ) * d2r;
+		}
+		else
+		{
+			alf = 98.2 * d2r;
+			p21 = 98.8841202 / 1440.0;
+			lonCenter = ( 129.30 - ( 360.0 / 233.0 * path ) ) * d2r;
+		}
+	}
+
+	ca = cos( alf );
+	if ( fabs( ca ) < 1.e-9 ) ca = 1.e-9;
+	sa = sin( alf );
+	const double e2c = es * ca * ca;
+	const double e2s = es * sa * sa;
+	const double oneEs = 1.0 - es;
+	w = ( 1.0 - e2c ) / oneEs;
+	w = w * w - 1.0;
+	q = e2s / oneEs;
+	t = ( e2s * ( 2.0 - es ) ) / ( oneEs * oneEs );
+	u = e2c / oneEs;
+	xj = oneEs * oneEs * oneEs;
+
+	// Simpson's rule over 0 to 90 degrees in steps of 9 degrees
+	double fb, fa2, fa4, fc1, fc3;
+	double sumb = 0, suma2 = 0, suma4 = 0, sumc1 = 0, sumc3 = 0;
+	for ( int i = 0; i <= 90; i += 9 )
+	{
+		const double weight = ( i == 0 || i == 90 ) ? 1.0 : ( ( i % 18 ) ? 4.0 : 2.0 );
+		Series( i, fb, fa2, fa4, fc1, fc3 );
+		sumb += weight * fb;
+		suma2 += weight * fa2;
+		suma4 += weight * fa4;
+		sumc1 += weight * fc1;
+		sumc3 += weight * fc3;
+	}
+	a2 = suma2 / 30.0;
+	a4 = suma4 / 60.0;
+	b = sumb / 30.0;
+	c1 = sumc1 / 15.0;
+	c3 = sumc3 / 45.0;
+}
+
+somBatch::~somBatch()
+{
+
+}
+
+int somBatch::Forward( const double* lon, const double* lat, double* x, double* y, int count ) const
+{
+	const double conv = 1.e-7;
+	const double rlm = pi * s_landsat_ratio;
+	const double rlm2 = rlm + 2.0 * pi;
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+
+	// solutions of the previous two points, and the branch they were found on
+	int warm = 0;
+	double warmTlamp = 0;
+	double warmTlam[ 2 ] = { 0, 0 };
+	int failed = 0;
+
+	for ( int i = 0; i < count; i++ )
+	{
+		double radlt = lat[ i ];
+		if ( radlt > 1.570796 ) radlt = 1.570796;
+		if ( radlt < -1.570796 ) radlt = -1.570796;
+		const double radln = lon[ i ] - lonCenter;
+		const double sinLat = sin( radlt );
+		const double cosLat = cos( radlt );
+		const double tanLat = ( 1.0 - es ) * sinLat / cosLat * sa;
+
+		double tlamp = 0;
+		if ( radlt >= 0.0 ) tlamp = pi / 2.0;
+		if ( start != 0.0 ) tlamp = 2.5 * pi;
+		if ( radlt < 0.0 ) tlamp = 1.5 * pi;
+
+		bool converged = false;
+		double tlam = 0;
+		double xlamt = 0;
+		for ( int n = 0; n < 3; )
+		{
+			double xlamp = radln + p21 * tlamp;
+			const double ab1 = cos( xlamp );
+			const double scl = ( ab1 >= 0.0 ) ? 1.0 : -1.0;
+			const double ab2 = tlamp - scl * sin( tlamp ) * pi / 2.0;
+
+			// start from the neighbours' solutions if they were on the same branch
+			double sav = tlamp;
+			if ( warm && warmTlamp == tlamp )
+			{
+				sav = ( warm > 1 ) ? 2.0 * warmTlam[ 0 ] - warmTlam[ 1 ] : warmTlam[ 0 ];
+			}
+			converged = false;
+			for ( int l = 0; l <= 50; l++ )
+			{
+				xlamt = radln + p21 * sav;
+				const double c = cos( xlamt );
+				if ( fabs( c ) < 1.e-7 ) xlamt = xlamt - 1.e-7;
+				tlam = atan( ( tanLat + sin( xlamt ) * ca ) / c ) + ab2;
+				if ( fabs( fabs( sav ) - fabs( tlam ) ) < conv )
+				{
+					converged = true;
+					break;
+				}
+				sav = tlam;
+			}
+			if ( !converged ) break;
+
+			// adjust for confusion at beginning and end of landsat orbits
+			n++;
+			if ( n >= 3 || ( tlam > rlm && tlam < rlm2 ) ) break;
+			if ( tlam < rlm ) tlamp = 2.5 * pi;
+			if ( tlam >= rlm2 ) tlamp = pi / 2.0;
+		}
+
+		if ( !converged )
+		{
+			x[ i ] = nan;
+			y[ i ] = nan;
+			warm = 0;
+			failed++;
+			continue;
+		}
+
+		warm = ( warm && warmTlamp == tlamp ) ? 2 : 1;
+		warmTlamp = tlamp;
+		warmTlam[ 1 ] = warmTlam[ 0 ];
+		warmTlam[ 0 ] = tlam;
+
+		// log( tan( pi / 4 + tphi / 2 ) ) written in terms of sin( tphi )
+		const double sinTphi = ( ( 1.0 - es ) * ca * sinLat - sa * cosLat * sin( xlamt ) ) / sqrt( 1.0 - es * sinLat * sinLat );
+		const double tanlg = 0.5 * log( ( 1.0 + sinTphi ) / ( 1.0 - sinTphi ) );
+		const double sd = sin( tlam );
+		const double cd = cos( tlam );
+		const double sdsq = sd * sd;
+		const double s = p21 * sa * cd * sqrt( ( 1.0 + t * sdsq ) / ( ( 1.0 + w * sdsq ) * ( 1.0 + q * sdsq ) ) );
+		const double d = sqrt( xj * xj + s * s );
+
+		// multiple angles from sin( tlam ) and cos( tlam )
+		const double sin2 = 2.0 * sd * cd;
+		const double sin3 = sd * ( 3.0 - 4.0 * sdsq );
+		const double sin4 = 2.0 * sin2 * ( 1.0 - 2.0 * sdsq );
+
+		// x is along the ground track and y across it, with the offsets swapped as in somfor()
+		x[ i ] = a * ( b * tlam + a2 * sin2 + a4 * sin4 - tanlg * s / d ) + falseNorthing;
+		y[ i ] = a * ( c1 * sd + c3 * sin3 + tanlg * xj / d ) + falseEasting;
+	}
+
+	return failed;
+}
+
+int somBatch::Inverse( const double* x, const double* y, double* lon, double* lat, int count ) const
+{
+	const double conv = 1.e-9;
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+
+	// solutions of the previous two points
+	int warm = 0;
+	double warmTlon[ 2 ] = { 0, 0 };
+	int failed = 0;
+
+	for ( int i = 0; i < count; i++ )
+	{
+		// offsets are swapped as in sominv()
+		const double sx = x[ i ] - falseNorthing;
+		const double sy = y[ i ] - falseEasting;
+
+		// solve for transformed longitude, from the neighbour's solution if there is one
+		bool converged = false;
+		double tlon = 0;
+		double s = 0;
+		for ( int attempt = warm ? 0 : 1; attempt < 2 && !converged; attempt++ )
+		{
+			if ( attempt == 0 )
+			{
+				tlon = ( warm > 1 ) ? 2.0 * warmTlon[ 0 ] - warmTlon[ 1 ] : warmTlon[ 0 ];
+			}
+			else
+			{
+				tlon = sx / ( a * b );
+			}
+
+			for ( int inumb = 0; inumb < 50; inumb++ )
+			{
+				const double sav = tlon;
+				const double sd = sin( tlon );
+				const double cd = cos( tlon );
+				const double sdsq = sd * sd;
+				const double sin2 = 2.0 * sd * cd;
+				s = p21 * sa * cd * sqrt( ( 1.0 + t * sdsq ) / ( ( 1.0 + w * sdsq ) * ( 1.0 + q * sdsq ) ) );
+				const double blon = ( sx / a ) + ( sy / a ) * s / xj - a2 * sin2 - a4 * 2.0 * sin2 * ( 1.0 - 2.0 * sdsq )
+					- ( s / xj ) * ( c1 * sd + c3 * sd * ( 3.0 - 4.0 * sdsq ) );
+				tlon = blon / b;
+				if ( fabs( tlon - sav ) < conv )
+				{
+					converged = true;
+					break;
+				}
+			}
+		}
+
+		if ( !converged )
+		{
+			lon[ i ] = nan;
+			lat[ i ] = nan;
+			warm = 0;
+			failed++;
+			continue;
+		}
+
+		warm = warm ? 2 : 1;
+		warmTlon[ 1 ] = warmTlon[ 0 ];
+		warmTlon[ 0 ] = tlon;
+
+		// transformed latitude
+		const double st = sin( tlon );
+		const double defac = exp( sqrt( 1.0 + s * s / xj / xj ) * ( sy / a - c1 * st - c3 * st * ( 3.0 - 4.0 * st * st ) ) );
+		const double tlat = 2.0 * ( atan( defac ) - ( pi / 4.0 ) );
+
+		// geodetic longitude
+		const double dd = st * st;
+		if ( fabs( cos( tlon ) ) < 1.e-7 ) tlon = tlon - 1.e-7;
+		const double bigk = sin( tlat );
+		const double bigk2 = bigk * bigk;
+		double xlamt = atan( ( ( 1.0 - bigk2 / ( 1.0 - es ) ) * tan( tlon ) * ca - bigk * sa * sqrt( ( 1.0 + q * dd )
+			* ( 1.0 - bigk2 ) - bigk2 * u ) / cos( tlon ) ) / ( 1.0 - bigk2 * ( 1.0 + u ) ) );
+
+		// correct inverse quadrant
+		const double sl = ( xlamt >= 0.0 ) ? 1.0 : -1.0;
+		const double scl = ( cos( tlon ) >= 0.0 ) ? 1.0 : -1.0;
+		xlamt = xlamt - ( ( pi / 2.0 ) * ( 1.0 - scl ) * sl );
+
+		// geodetic latitude
+		if ( fabs( sa ) < 1.e-7 )
+		{
+			lat[ i ] = asin( bigk / sqrt( ( 1.0 - es ) * ( 1.0 - es ) + es * bigk2 ) );
+		}
+		else
+		{
+			lat[ i ] = atan( ( tan( tlon ) * cos( xlamt ) - ca * sin( xlamt ) ) / ( ( 1.0 - es ) * sa ) );
+		}
+		lon[ i ] = AdjustLongitude( xlamt - p21 * tlon + lonCenter );
+	}
+
+	return failed;
+}
+
+void somBatch::Series( double dlam, double& fb, double& fa2, double& fa4, double& fc1, double& fc3 ) const
+{
+	dlam = dlam * 0.0174532925;
+	const double sd = sin( dlam );
+	const double sdsq = sd * sd;
+	const double s = p21 * sa * cos( dlam ) * sqrt( ( 1.0 + t * sdsq ) / ( ( 1.0 + w * sdsq ) * ( 1.0 + q * sdsq ) ) );
+	const double h = sqrt( ( 1.0 + q * sdsq ) / ( 1.0 + w * sdsq ) ) * ( ( ( 1.0 + w * sdsq ) / ( ( 1.0 + q * sdsq ) * ( 1.0 + q * sdsq ) ) ) - p21 * ca );
+	const double sq = sqrt( xj * xj + s * s );
+	fb = ( h * xj - s * s ) / sq;
+	fa2 = fb * cos( 2.0 * dlam );
+	fa4 = fb * cos( 4.0 * dlam );
+	const double fc = s * ( h + xj ) / sq;
+	fc1 = fc * cos( dlam );
+	fc3 = fc * cos( 3.0 * dlam );
+}
+
+double somBatch::UnpackAngle( double packed )
+{
+	const double sign = ( packed < 0 ) ? -1.0 : 1.0;
+	double sec = fabs( packed );
+	const double deg = double( long( sec / 1000000.0 ) );
+	sec -= deg * 1000000.0;
+	const double min = double( long( sec / 1000.0 ) );
+	sec -= min * 1000.0;
+	return sign * ( deg * 3600.0 + min * 60.0 + sec ) * 4.848136811095359e-6;
+}
+
+double somBatch::AdjustLongitude( double angle )
+{
+	if ( fabs( angle ) <= pi ) return angle;
+	angle = fmod( angle + pi, 2.0 * pi );
+	if ( angle < 0 ) angle += 2.0 * pi;
+	return angle - pi;
+}
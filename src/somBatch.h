@@ -0,0 +1,70 @@
+#ifndef SOMBATCH_H_INCLUDED
+#define SOMBATCH_H_INCLUDED
+
+#include <vector>
+
+//! Space Oblique Mercator transformations for many points at once.
+//! Uses the same equations as gctp's somfor.c and sominv.c, but keeps the
+//! projection constants in the object instead of static storage, so several
+//! projections can be used at the same time and from any number of threads.
+//! Points are passed as separate coordinate arrays. Each point starts its
+//! iteration from the solution of the point before it, which is nearly the
+//! answer for neighbouring pixels, so points along a scan line should be
+//! passed in order.
+//! Coordinates follow gctp: longitude and latitude in radians, x and y in
+//! meters as returned by the SOM for_trans and inv_trans functions.
+class somBatch
+{
+public:
+
+	//! Sets up a projection from gctp SOM parameters.
+	//! \param parameters the 15 gctp projection parameters, such as hdfField::ProjectionParameters()
+	somBatch( const std::vector<double>& parameters );
+
+	//! Destructor
+	~somBatch();
+
+	//! Converts longitude, latitude to x, y.
+	//! Points that do not converge get x and y of NaN.
+	//! \returns the number of points that did not converge
+	int Forward( const double* lon, const double* lat, double* x, double* y, int count ) const;
+
+	//! Converts x, y to longitude, latitude.
+	//! Points that do not converge get a longitude and latitude of NaN.
+	//! \returns the number of points that did not converge
+	int Inverse( const double* x, const double* y, double* lon, double* lat, int count ) const;
+
+protected:
+
+	//! Computes one step of the Fourier series for the a, b and c coefficients.
+	//! \param dlam transformed longitude in degrees
+	void Series( double dlam, double& fb, double& fa2, double& fa4, double& fc1, double& fc3 ) const;
+
+	//! Returns a packed DMS angle ( DDDMMMSSS.SS ) in radians.
+	static double UnpackAngle( double packed );
+
+	//! Returns an angle in radians adjusted to the range -pi to pi.
+	static double AdjustLongitude( double angle );
+
+	double lonCenter; //!< longitude of the ascending orbit at the equator
+	double a; //!< semi-major axis
+	double b; //!< series coefficient b
+	double a2; //!< series coefficient a2
+	double a4; //!< series coefficient a4
+	double c1; //!< series coefficient c1
+	double c3; //!< series coefficient c3
+	double q; //!< e^2 sin^2( alf ) / ( 1 - e^2 )
+	double t; //!< e^2 sin^2( alf ) ( 2 - e^2 ) / ( 1 - e^2 )^2
+	double u; //!< e^2 cos^2( alf ) / ( 1 - e^2 )
+	double w; //!< ( ( 1 - e^2 cos^2( alf ) ) / ( 1 - e^2 ) )^2 - 1
+	double xj; //!< ( 1 - e^2 )^3
+	double p21; //!< satellite period over earth rotation period
+	double sa; //!< sin( alf )
+	double ca; //!< cos( alf )
+	double es; //!< eccentricity squared
+	double start; //!< nonzero if the orbit starts at its end
+	double falseEasting; //!< x offset in meters
+	double falseNorthing; //!< y offset in meters
+};
+
+#endif // SOMBATCH_H_INCLUDED
@@ -0,0 +1,540 @@
+#include "somLattice.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <qdir.h>
+
+#include "qutility.h"
+
+//! identifies lattice cache files
+static const char s_lattice_magic[ 8 ] = { 'S', 'O', 'M', 'L', 'A', 'T', 'T', '\0' };
+
+//! layout version of lattice cache files
+static const qint32 s_lattice_version = 1;
+
+//! lattice spacing tried first, in meters
+static const double s_lattice_step = 17600.0;
+
+//! the spacing is halved until the lattice error is below this, in meters
+static const double s_lattice_tolerance = 5.0;
+
+//! smallest lattice spacing, in meters
+static const double s_lattice_min_step = 1100.0;
+
+//! largest distance in meters between a node and its exact round trip
+static const double s_round_trip_tolerance = 10.0;
+
+//! points projected exactly at a time when leaving the lattice
+static const int s_exact_run = 64;
+
+//! Newton steps allowed for one point
+static const int s_max_iterations = 12;
+
+//! Newton step in cells small enough to stop
+static const double s_convergence = 1e-7;
+
+std::map< int, ptr<somLattice> > somLattice::s_paths;
+
+//! Returns the unit vector pointing at a longitude, latitude.
+static inline void UnitVector( double lon, double lat, double* vector )
+{
+	const double cosLat = cos( lat );
+	vector[ 0 ] = cosLat * cos( lon );
+	vector[ 1 ] = cosLat * sin( lon );
+	vector[ 2 ] = sin( lat );
+}
+
+somLattice::somLattice( const QString& fileName, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects )
+:
+exact( parameters ),
+buffer(),
+file( fileName ),
+mapped( 0 ),
+head( 0 ),
+blocks( 0 ),
+nodes( 0 ),
+bounds()
+{
+	// map an existing lattice
+	if( file.open( QIODevice::ReadOnly ) )
+	{
+		mapped = file.map( 0, file.size() );
+		if( mapped && Attach( ( const char* ) mapped, file.size(), parameters, blockRects ) )
+		{
+			return;
+		}
+		if( mapped )
+		{
+			file.unmap( mapped );
+			mapped = 0;
+		}
+		file.close();
+	}
+
+	// build a new lattice, as coarse as the tolerance allows
+	for( double step = s_lattice_step; ; step /= 2.0 )
+	{
+		Build( step, parameters, blockRects );
+		if( !IsValid() || MaxError() <= s_lattice_tolerance || step / 2.0 < s_lattice_min_step )
+		{
+			break;
+		}
+	}
+
+	if( !IsValid() )
+	{
+		return;
+	}
+
+	// save it next to the final file so a reader never maps a partial file
+	QFile temporary( fileName + ".tmp" );
+	if( !temporary.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+	{
+		return;
+	}
+	const bool written = temporary.write( &buffer[ 0 ], buffer.size() ) == qint64( buffer.size() );
+	temporary.close();
+	QFile::remove( fileName );
+	if( !written || !temporary.rename( fileName ) )
+	{
+		temporary.remove();
+		return;
+	}
+
+	// use the mapped copy so the memory is shared with other sessions
+	if( file.open( QIODevice::ReadOnly ) )
+	{
+		mapped = file.map( 0, file.size() );
+		if( mapped && Attach( ( const char* ) mapped, file.size(), parameters, blockRects ) )
+		{
+			std::vector<char>().swap( buffer );
+			return;
+		}
+		if( mapped )
+		{
+			file.unmap( mapped );
+			mapped = 0;
+		}
+		file.close();
+	}
+	Attach( &buffer[ 0 ], buffer.size(), parameters, blockRects );
+}
+
+somLattice::~somLattice()
+{
+	if( mapped )
+	{
+		file.unmap( mapped );
+	}
+}
+
+ptr<somLattice> somLattice::FromPath( int path, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects )
+{
+	ptr<somLattice>& lattice = s_paths[ path ];
+	if( !lattice.IsValid() || !lattice->Attach( ( const char* ) lattice->head, -1, parameters, blockRects ) )
+	{
+		QString directory = getAppPath( "cache" );
+		QDir().mkpath( directory );
+		lattice = new somLattice( directory + QString( "/som_path_%1.lattice" ).arg( path, 3, 10, QChar( '0' ) ), parameters, blockRects );
+	}
+	return lattice;
+}
+
+bool somLattice::IsValid() const
+{
+	return head != 0;
+}
+
+double somLattice::MaxError() const
+{
+	return head ? head->maxError : std::numeric_limits<double>::infinity();
+}
+
+double somLattice::Step() const
+{
+	return head ? head->step : 0.0;
+}
+
+int somLattice::Forward( const double* lon, const double* lat, double* x, double* y, int count ) const
+{
+	position where;
+	bool warm = false;
+	int hint = 0;
+	int failed = 0;
+	int projected = 0;
+
+	for( int i = 0; i < count; i++ )
+	{
+		// continue from the previous point, otherwise start from the exact projection
+		if( !warm || !Invert( lon[ i ], lat[ i ], where ) )
+		{
+			warm = false;
+
+			// project a run of points exactly, so points off the lattice keep
+			// the warm start of somBatch
+			if( i >= projected )
+			{
+				projected = std::min( i + s_exact_run, count );
+				exact.Forward( &lon[ i ], &lat[ i ], &x[ i ], &y[ i ], projected - i );
+			}
+			if( x[ i ] != x[ i ] || y[ i ] != y[ i ] )
+			{
+				failed++;
+				continue;
+			}
+
+			// points off the path keep the exact projection
+			if( !Locate( x[ i ], y[ i ], hint, where ) || !Invert( lon[ i ], lat[ i ], where ) )
+			{
+				continue;
+			}
+		}
+
+		warm = true;
+		hint = where.block;
+		Som( where, x[ i ], y[ i ] );
+	}
+
+	return failed;
+}
+
+void somLattice::Build( double step, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects )
+{
+	head = 0;
+	blocks = 0;
+	nodes = 0;
+
+	// project the nodes of every block
+	const int numBlocks = int( blockRects.size() );
+	std::vector<block> entries( numBlocks );
+	std::vector< std::vector<double> > blockNodes( numBlocks );
+	std::vector<double> somX, somY, lon, lat, checkX, checkY;
+	qint64 numNodes = 0;
+	for( int k = 0; k < numBlocks; k++ )
+	{
+		const hdfRect& rect = blockRects[ k ];
+		block& entry = entries[ k ];
+		entry.left = rect.Left();
+		entry.top = rect.Top();
+		entry.right = rect.Right();
+		entry.bottom = rect.Bottom();
+		entry.nx = 0;
+		entry.ny = 0;
+		entry.offset = numNodes;
+		if( rect.WidthAbs() <= 0 || rect.HeightAbs() <= 0 )
+		{
+			continue;
+		}
+
+		const int nx = int( ceil( rect.WidthAbs() / step ) ) + 1;
+		const int ny = int( ceil( rect.HeightAbs() / step ) ) + 1;
+		const int size = nx * ny;
+		somX.resize( size );
+		somY.resize( size );
+		lon.resize( size );
+		lat.resize( size );
+		checkX.resize( size );
+		checkY.resize( size );
+		for( int i = 0; i < nx; i++ )
+		{
+			for( int j = 0; j < ny; j++ )
+			{
+				somX[ i * ny + j ] = entry.left + ( entry.right - entry.left ) * i / ( nx - 1 );
+				somY[ i * ny + j ] = entry.top + ( entry.bottom - entry.top ) * j / ( ny - 1 );
+			}
+		}
+
+		if( exact.Inverse( &somX[ 0 ], &somY[ 0 ], &lon[ 0 ], &lat[ 0 ], size ) != 0
+			|| exact.Forward( &lon[ 0 ], &lat[ 0 ], &checkX[ 0 ], &checkY[ 0 ], size ) != 0 )
+		{
+			continue;
+		}
+
+		// leave out blocks the exact forward projection puts elsewhere, such
+		// as the start of a path that gctp assigns to the end of the orbit
+		bool roundTrip = true;
+		for( int n = 0; n < size && roundTrip; n++ )
+		{
+			roundTrip = fabs( checkX[ n ] - somX[ n ] ) < s_round_trip_tolerance && fabs( checkY[ n ] - somY[ n ] ) < s_round_trip_tolerance;
+		}
+		if( !roundTrip )
+		{
+			continue;
+		}
+
+		entry.nx = nx;
+		entry.ny = ny;
+		numNodes += size;
+		blockNodes[ k ].resize( size * 3 );
+		for( int n = 0; n < size; n++ )
+		{
+			UnitVector( lon[ n ], lat[ n ], &blockNodes[ k ][ n * 3 ] );
+		}
+	}
+
+	buffer.assign( sizeof( header ) + numBlocks * sizeof( block ) + numNodes * 3 * sizeof( double ), 0 );
+
+	header* newHead = ( header* ) &buffer[ 0 ];
+	memcpy( newHead->magic, s_lattice_magic, sizeof( s_lattice_magic ) );
+	newHead->version = s_lattice_version;
+	newHead->numBlocks = numBlocks;
+	for( int p = 0; p < 15; p++ )
+	{
+		newHead->parameters[ p ] = ( p < int( parameters.size() ) ) ? parameters[ p ] : 0.0;
+	}
+	newHead->step = step;
+	newHead->maxError = 0;
+
+	char* newBlocks = &buffer[ sizeof( header ) ];
+	double* newNodes = ( double* ) ( newBlocks + numBlocks * sizeof( block ) );
+	for( int k = 0; k < numBlocks; k++ )
+	{
+		memcpy( newBlocks + k * sizeof( block ), &entries[ k ], sizeof( block ) );
+		if( !blockNodes[ k ].empty() )
+		{
+			memcpy( newNodes + entries[ k ].offset * 3, &blockNodes[ k ][ 0 ], blockNodes[ k ].size() * sizeof( double ) );
+		}
+	}
+
+	if( numNodes == 0 || !Attach( &buffer[ 0 ], buffer.size(), parameters, blockRects ) )
+	{
+		head = 0;
+		std::vector<char>().swap( buffer );
+		return;
+	}
+	newHead->maxError = MeasureError();
+}
+
+double somLattice::MeasureError() const
+{
+	double maxError = 0;
+	std::vector<double> somX, somY, lon, lat;
+
+	for( int k = 0; k < head->numBlocks; k++ )
+	{
+		const block& entry = blocks[ k ];
+		if( entry.nx == 0 )
+		{
+			continue;
+		}
+
+		const int size = ( entry.nx - 1 ) * ( entry.ny - 1 );
+		somX.resize( size );
+		somY.resize( size );
+		lon.resize( size );
+		lat.resize( size );
+		for( int i = 0; i < entry.nx - 1; i++ )
+		{
+			for( int j = 0; j < entry.ny - 1; j++ )
+			{
+				somX[ i * ( entry.ny - 1 ) + j ] = entry.left + ( entry.right - entry.left ) * ( i + 0.5 ) / ( entry.nx - 1 );
+				somY[ i * ( entry.ny - 1 ) + j ] = entry.top + ( entry.bottom - entry.top ) * ( j + 0.5 ) / ( entry.ny - 1 );
+			}
+		}
+
+		if( exact.Inverse( &somX[ 0 ], &somY[ 0 ], &lon[ 0 ], &lat[ 0 ], size ) != 0 )
+		{
+			return std::numeric_limits<double>::infinity();
+		}
+
+		for( int n = 0; n < size; n++ )
+		{
+			position where;
+			double x, y;
+			if( !Locate( somX[ n ], somY[ n ], k, where ) || !Invert( lon[ n ], lat[ n ], where ) )
+			{
+				return std::numeric_limits<double>::infinity();
+			}
+			Som( where, x, y );
+			maxError = std::max( maxError, sqrt( square( x - somX[ n ] ) + square( y - somY[ n ] ) ) );
+		}
+	}
+
+	return maxError;
+}
+
+bool somLattice::Attach( const char* data, qint64 size, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects )
+{
+	// a negative size checks data that is already attached
+	const bool attached = size < 0;
+	if( !data || ( !attached && size < qint64( sizeof( header ) ) ) )
+	{
+		return false;
+	}
+
+	const header* newHead = ( const header* ) data;
+	const block* newBlocks = ( const block* ) ( data + sizeof( header ) );
+	if( memcmp( newHead->magic, s_lattice_magic, sizeof( s_lattice_magic ) ) != 0
+		|| newHead->version != s_lattice_version
+		|| newHead->numBlocks != qint32( blockRects.size() )
+		|| ( !attached && size < qint64( sizeof( header ) + newHead->numBlocks * sizeof( block ) ) ) )
+	{
+		return false;
+	}
+
+	for( int p = 0; p < 15; p++ )
+	{
+		if( newHead->parameters[ p ] != ( ( p < int( parameters.size() ) ) ? parameters[ p ] : 0.0 ) )
+		{
+			return false;
+		}
+	}
+
+	qint64 numNodes = 0;
+	for( int k = 0; k < newHead->numBlocks; k++ )
+	{
+		const block& entry = newBlocks[ k ];
+		const hdfRect& rect = blockRects[ k ];
+		if( entry.left != rect.Left() || entry.top != rect.Top() || entry.right != rect.Right() || entry.bottom != rect.Bottom()
+			|| entry.offset != numNodes || ( entry.nx != 0 && ( entry.nx < 2 || entry.ny < 2 ) ) )
+		{
+			return false;
+		}
+		numNodes += qint64( entry.nx ) * entry.ny;
+	}
+
+	if( !attached && size != qint64( sizeof( header ) + newHead->numBlocks * sizeof( block ) + numNodes * 3 * sizeof( double ) ) )
+	{
+		return false;
+	}
+
+	head = newHead;
+	blocks = newBlocks;
+	nodes = ( const double* ) ( data + sizeof( header ) + newHead->numBlocks * sizeof( block ) );
+
+	// bounds of all blocks in the lattice, to reject points quickly
+	bounds = hdfRect();
+	bool first = true;
+	for( int k = 0; k < newHead->numBlocks; k++ )
+	{
+		const block& entry = newBlocks[ k ];
+		if( entry.nx == 0 )
+		{
+			continue;
+		}
+		const hdfRect rect( std::min( entry.left, entry.right ), std::min( entry.top, entry.bottom ),
+			std::max( entry.left, entry.right ), std::max( entry.top, entry.bottom ) );
+		if( first )
+		{
+			bounds = rect;
+			first = false;
+		}
+		else
+		{
+			bounds.Include( rect );
+		}
+	}
+	return true;
+}
+
+bool somLattice::Locate( double x, double y, int hint, position& where ) const
+{
+	const double edge = 1e-9;
+	const int numBlocks = head->numBlocks;
+
+	if( x < bounds.Left() || x > bounds.Right() || y < bounds.Top() || y > bounds.Bottom() )
+	{
+		return false;
+	}
+
+	// try the hint and its neighbours before the other blocks
+	for( int n = -3; n < numBlocks; n++ )
+	{
+		const int k = ( n == -3 ) ? hint : ( n == -2 ) ? hint - 1 : ( n == -1 ) ? hint + 1 : n;
+		if( k < 0 || k >= numBlocks || ( n >= 0 && k >= hint - 1 && k <= hint + 1 ) )
+		{
+			continue;
+		}
+
+		const block& entry = blocks[ k ];
+		if( entry.nx == 0 )
+		{
+			continue;
+		}
+
+		const double fi = ( x - entry.left ) / ( entry.right - entry.left ) * ( entry.nx - 1 );
+		const double fj = ( y - entry.top ) / ( entry.bottom - entry.top ) * ( entry.ny - 1 );
+		if( fi < -edge || fi > entry.nx - 1 + edge || fj < -edge || fj > entry.ny - 1 + edge )
+		{
+			continue;
+		}
+
+		where.block = k;
+		where.i = std::min( std::max( int( floor( fi ) ), 0 ), entry.nx - 2 );
+		where.j = std::min( std::max( int( floor( fj ) ), 0 ), entry.ny - 2 );
+		where.u = fi - where.i;
+		where.v = fj - where.j;
+		return true;
+	}
+
+	return false;
+}
+
+void somLattice::Som( const position& where, double& x, double& y ) const
+{
+	const block& entry = blocks[ where.block ];
+	x = entry.left + ( entry.right - entry.left ) * ( where.i + where.u ) / ( entry.nx - 1 );
+	y = entry.top + ( entry.bottom - entry.top ) * ( where.j + where.v ) / ( entry.ny - 1 );
+}
+
+bool somLattice::Invert( double lon, double lat, position& where ) const
+{
+	double target[ 3 ];
+	UnitVector( lon, lat, target );
+
+	for( int iteration = 0; iteration < s_max_iterations; iteration++ )
+	{
+		const block& entry = blocks[ where.block ];
+		const double* p00 = nodes + ( entry.offset + where.i * entry.ny + where.j ) * 3;
+		const double* p01 = p00 + 3;
+		const double* p10 = p00 + entry.ny * 3;
+		const double* p11 = p10 + 3;
+
+		// residual of the bilinear interpolation at u, v and its derivatives
+		const double u = where.u;
+		const double v = where.v;
+		double f[ 3 ], fu[ 3 ], fv[ 3 ];
+		for( int c = 0; c < 3; c++ )
+		{
+			f[ c ] = ( 1 - u ) * ( 1 - v ) * p00[ c ] + u * ( 1 - v ) * p10[ c ] + ( 1 - u ) * v * p01[ c ] + u * v * p11[ c ] - target[ c ];
+			fu[ c ] = ( 1 - v ) * ( p10[ c ] - p00[ c ] ) + v * ( p11[ c ] - p01[ c ] );
+			fv[ c ] = ( 1 - u ) * ( p01[ c ] - p00[ c ] ) + u * ( p11[ c ] - p10[ c ] );
+		}
+
+		// Gauss-Newton step, the lattice is a surface in three dimensions
+		const double uu = fu[ 0 ] * fu[ 0 ] + fu[ 1 ] * fu[ 1 ] + fu[ 2 ] * fu[ 2 ];
+		const double uv = fu[ 0 ] * fv[ 0 ] + fu[ 1 ] * fv[ 1 ] + fu[ 2 ] * fv[ 2 ];
+		const double vv = fv[ 0 ] * fv[ 0 ] + fv[ 1 ] * fv[ 1 ] + fv[ 2 ] * fv[ 2 ];
+		const double uf = fu[ 0 ] * f[ 0 ] + fu[ 1 ] * f[ 1 ] + fu[ 2 ] * f[ 2 ];
+		const double vf = fv[ 0 ] * f[ 0 ] + fv[ 1 ] * f[ 1 ] + fv[ 2 ] * f[ 2 ];
+		const double det = uu * vv - uv * uv;
+		if( det <= 0 )
+		{
+			return false;
+		}
+
+		const double du = -( vv * uf - uv * vf ) / det;
+		const double dv = -( uu * vf - uv * uf ) / det;
+		where.u += du;
+		where.v += dv;
+
+		// move to the cell the step landed in
+		if( where.u < 0 || where.u > 1 || where.v < 0 || where.v > 1 )
+		{
+			double x, y;
+			Som( where, x, y );
+			if( !Locate( x, y, where.block, where ) )
+			{
+				return false;
+			}
+		}
+
+		if( fabs( du ) + fabs( dv ) < s_convergence )
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,120 @@
+#ifndef SOMLATTICE_H_INCLUDED
+#define SOMLATTICE_H_INCLUDED
+
+#include <map>
+#include <vector>
+#include <qfile.h>
+#include <qstring.h>
+
+#include "hdfBase.h"
+#include "ptr.h"
+#include "somBatch.h"
+
+//! Latitude, longitude of a coarse lattice over the blocks of a MISR path.
+//! Projecting from latitude, longitude to SOM becomes an inversion of the
+//! bilinear interpolation of the lattice, which takes a couple of Newton
+//! steps per point when points are passed in scan line order. The lattice
+//! of a path only depends on its SOM parameters and block rectangles, so it
+//! is saved to a file and memory mapped by later sessions.
+//! The largest error of the interpolation, measured at the center of every
+//! lattice cell when the lattice is built, is kept with the lattice. Users
+//! should check MaxError() against their own tolerance.
+//! Coordinates follow somBatch.
+class somLattice
+{
+public:
+
+	//! Maps a lattice from a file, or builds it and saves it to the file if
+	//! the file is missing or was built for other parameters.
+	//! \param fileName the cache file
+	//! \param parameters the 15 gctp SOM parameters of the path
+	//! \param blockRects the SOM rectangle of each block, indexed by block number. Empty rectangles are skipped.
+	somLattice( const QString& fileName, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects );
+
+	//! Destructor
+	~somLattice();
+
+	//! Returns a shared lattice for a path, mapped from the cache directory.
+	static ptr<somLattice> FromPath( int path, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects );
+
+	//! Returns true if the lattice was loaded or built.
+	bool IsValid() const;
+
+	//! Returns the largest error in meters of Forward() over the path.
+	double MaxError() const;
+
+	//! Returns the lattice spacing in meters.
+	double Step() const;
+
+	//! Converts longitude, latitude in radians to SOM x, y in meters.
+	//! Points off the lattice are projected exactly with somBatch.
+	//! \returns the number of points that did not converge, their x and y are NaN
+	int Forward( const double* lon, const double* lat, double* x, double* y, int count ) const;
+
+protected:
+
+	//! File header.
+	struct header
+	{
+		char magic[ 8 ]; //!< identifies the file type
+		qint32 version; //!< layout version
+		qint32 numBlocks; //!< number of block entries
+		double parameters[ 15 ]; //!< SOM parameters the lattice was built for
+		double step; //!< lattice spacing in meters
+		double maxError; //!< largest error of Forward() in meters
+	};
+
+	//! Lattice of one block.
+	//! Nodes are stored x-major as unit vectors, which interpolate well near the poles.
+	struct block
+	{
+		double left; //!< SOM x of the first column of nodes
+		double top; //!< SOM y of the first row of nodes
+		double right; //!< SOM x of the last column of nodes
+		double bottom; //!< SOM y of the last row of nodes
+		qint32 nx; //!< nodes in x
+		qint32 ny; //!< nodes in y
+		qint64 offset; //!< index of the first node
+	};
+
+	//! A position in the lattice.
+	struct position
+	{
+		int block; //!< index of the block entry
+		int i; //!< cell in x
+		int j; //!< cell in y
+		double u; //!< position in the cell in x, 0 to 1
+		double v; //!< position in the cell in y, 0 to 1
+	};
+
+	//! Builds the lattice with a given spacing into buffer.
+	void Build( double step, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects );
+
+	//! Measures the error of Forward() at the center of every cell.
+	double MeasureError() const;
+
+	//! Sets the pointers into the lattice data, returns false if the data is not a valid lattice for parameters and blockRects.
+	bool Attach( const char* data, qint64 size, const std::vector<double>& parameters, const std::vector<hdfRect>& blockRects );
+
+	//! Finds the cell containing SOM x, y, starting the search at block hint.
+	bool Locate( double x, double y, int hint, position& where ) const;
+
+	//! Returns the SOM coordinates of a position.
+	void Som( const position& where, double& x, double& y ) const;
+
+	//! Moves where to the lattice position with longitude, latitude lon, lat.
+	bool Invert( double lon, double lat, position& where ) const;
+
+	somBatch exact; //!< exact projection, used to find the first point of a batch
+	std::vector<char> buffer; //!< lattice data, if not mapped
+	QFile file; //!< cache file, if mapped
+	uchar* mapped; //!< mapped cache file
+	const header* head; //!< the header of the lattice data
+	const block* blocks; //!< the block entries of the lattice data
+	const double* nodes; //!< the nodes of the lattice data
+	hdfRect bounds; //!< bounding rectangle of the blocks in the lattice
+
+	static std::map< int, ptr<somLattice> > s_paths; //!< lattices shared by FromPath()
+};
+
+#endif // SOMLATTICE_H_INCLUDED
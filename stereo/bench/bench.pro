@@ -0,0 +1,20 @@
+
+unix {
+  OBJECTS_DIR = obj
+}
+
+DESTDIR = ../../bin
+TARGET = colorize-bench
+
+INCLUDEPATH += ..
+
+SOURCES += colorize_bench.cpp
+SOURCES += ../colorize.cpp
+
+TEMPLATE     = app
+CONFIG -= qt
+CONFIG += warn_on stl console release
+
+QMAKE_CXXFLAGS += -std=c++0x
+
+LANGUAGE     = C++
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include "colorize.h"
+
+// colorize-bench
+// + times ColorizeRow on a full GM block against the float loop viewport::Colorize used before it
+// + the red channel is at full resolution, green and blue are 4x reduced as in off nadir cameras,
+//   so their rows are gathered once and repeated like viewport::GatherRow does
+// + checks that both produce the same bytes, exits with 1 if they do not
+// + build with qmake bench.pro && make in this directory
+// + usage: colorize-bench [runs], best of 30 runs by default
+
+// a GM block at full resolution
+static const int s_width = 512;
+static const int s_height = 2048;
+
+// fill value of MISR radiance
+static const unsigned short s_fill_value = 65535;
+
+static double Seconds()
+{
+    timeval now;
+    gettimeofday( & now, 0 );
+    return now.tv_sec + 1e-6 * now.tv_usec;
+}
+
+// the loop viewport::Colorize ran before the row kernels
+static void ColorizeReference( const std::vector<unsigned short> channels[3], const float scale[3], std::vector<unsigned char> & image )
+{
+    for ( int y = 0 ; y < s_height ; y++ )
+    {
+        for ( int x = 0 ; x < s_width ; x++ )
+        {
+            unsigned char * pixel = & image[ 4 * ( y * s_width + x ) ];
+            bool isTransparent = false;
+
+            for ( int i = 0 ; i < 3 ; i++ )
+            {
+                // green and blue hold one sample for each 4 x 4 pixels
+                const int reduce = ( i == 0 ) ? 1 : 4;
+                unsigned short value = channels[i][ ( y / reduce ) * ( s_width / reduce ) + x / reduce ];
+
+                float color = ( value >> 2 ) * scale[i];
+                if ( color < 0.0f ) color = 0.0f;
+                if ( color > 255.0f ) color = 255.0f;
+
+                pixel[i] = ( unsigned char ) color;
+                isTransparent = isTransparent || value == s_fill_value;
+            }
+
+            pixel[3] = isTransparent ? 0 : 255;
+        }
+    }
+}
+
+// the gather and row kernel viewport::Colorize runs now
+static void ColorizeKernel( const std::vector<unsigned short> channels[3], const float scale[3], std::vector<unsigned char> & image )
+{
+    std::vector<unsigned short> rowSamples[3];
+    colorizeRows eye;
+
+    for ( int i = 0 ; i < 3 ; i++ )
+    {
+        rowSamples[i].resize( s_width );
+        eye.rows[i] = & rowSamples[i][0];
+        eye.scale[i] = scale[i];
+        eye.fillValue[i] = s_fill_value;
+    }
+
+    for ( int y = 0 ; y < s_height ; y++ )
+    {
+        for ( int i = 0 ; i < 3 ; i++ )
+        {
+            const int reduce = ( i == 0 ) ? 1 : 4;
+
+            // reduced rows repeat, gather them only when they change
+            if ( y % reduce == 0 )
+            {
+                const unsigned short * source = & channels[i][ ( y / reduce ) * ( s_width / reduce ) ];
+
+                for ( int x = 0 ; x < s_width ; x++ )
+                {
+                    rowSamples[i][x] = source[ x / reduce ];
+                }
+            }
+        }
+
+        eye.pixel = & image[ 4 * y * s_width ];
+        ColorizeRow( eye, s_width );
+    }
+}
+
+typedef void ( * colorizeBlock )( const std::vector<unsigned short> channels[3], const float scale[3], std::vector<unsigned char> & image );
+
+// returns the best time of runs calls in milliseconds
+static double Time( colorizeBlock colorize, int runs, const std::vector<unsigned short> channels[3], const float scale[3], std::vector<unsigned char> & image )
+{
+    double best = 0.0;
+
+    for ( int run = 0 ; run < runs ; run++ )
+    {
+        double start = Seconds();
+        colorize( channels, scale, image );
+        double elapsed = 1000.0 * ( Seconds() - start );
+
+        if ( run == 0 || elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+int main( int argc, char * argv[] )
+{
+    const int runs = ( argc > 1 ) ? atoi( argv[1] ) : 30;
+
+    // radiance with a sprinkling of fill values, the same every run
+    std::vector<unsigned short> channels[3];
+    srand( 1 );
+
+    for ( int i = 0 ; i < 3 ; i++ )
+    {
+        const int reduce = ( i == 0 ) ? 1 : 4;
+        channels[i].resize( ( s_width / reduce ) * ( s_height / reduce ) );
+
+        for ( unsigned int j = 0 ; j < channels[i].size() ; j++ )
+        {
+            channels[i][j] = ( rand() % 64 == 0 ) ? s_fill_value : ( unsigned short )( rand() % 16384 );
+        }
+    }
+
+    // a scale that saturates the brightest values, as a stretched view does
+    const float scale[3] = { 255.0f / 900.0f, 255.0f / 900.0f, 255.0f / 900.0f };
+
+    std::vector<unsigned char> reference( 4 * s_width * s_height );
+    std::vector<unsigned char> image( 4 * s_width * s_height );
+
+    double referenceTime = Time( ColorizeReference, runs, channels, scale, reference );
+    double kernelTime = Time( ColorizeKernel, runs, channels, scale, image );
+
+    printf( "%d x %d block, best of %d runs\n", s_width, s_height, runs );
+    printf( "  float loop       %6.2f ms\n", referenceTime );
+    printf( "  %-6s kernel    %6.2f ms  (%.1fx)\n", ColorizeKernelName(), kernelTime, referenceTime / kernelTime );
+
+    if ( memcmp( & reference[0], & image[0], image.size() ) != 0 )
+    {
+        printf( "Output differs from the float loop\n" );
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+unix {
+  OBJECTS_DIR = obj
+}
+
+macx: DEFINES += MACINTOSH
+unix:!macx: DEFINES += LINUX
+
+MISRDIR = /home/landon/misr_stereo
+HDF4INC = /usr/local/include/
+HDF4LIB = /usr/local/lib/
+SZIPDIR = /usr/local/
+
+DESTDIR = ../../bin
+TARGET = fusion-test
+
+INCLUDEPATH += ..
+INCLUDEPATH += $$MISRDIR/src
+
+SOURCES += fusion_test.cpp
+SOURCES += ../blockfilecache.cpp
+SOURCES += ../datablockcache.cpp
+SOURCES += ../../src/hdfDataNode.cpp
+SOURCES += ../hdfDataSource.cpp
+SOURCES += ../hdfField.cpp
+SOURCES += ../hdfFile.cpp
+SOURCES += ../hdfGrid.cpp
+SOURCES += ../../src/stringaux.cpp
+
+TEMPLATE     = app
+CONFIG -= qt
+CONFIG += warn_on stl console thread release
+
+QMAKE_CXXFLAGS += -std=c++0x
+
+INCLUDEPATH += ../../hdfeos/include
+LIBS        += -L../../lib -lhdfeos
+
+INCLUDEPATH += $$MISRDIR/gctp
+LIBS        += -lgctp
+
+INCLUDEPATH += $$HDF4INC
+LIBS        += -L$$HDF4LIB -lmfhdf -ldf
+
+INCLUDEPATH += $$SZIPDIR/include
+LIBS        += -L$$SZIPDIR/lib -lsz
+
+LIBS        += -ljpeg -lz
+
+LANGUAGE     = C++
@@ -0,0 +1,231 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <vector>
+
+#include "hdfDataSource.h"
+
+// fusion-test
+// + checks the fused hdfBrfSource and hdfBdasSource against the same operator trees evaluated node by node
+// + checks that a BRF rewired through setInput, and a BDAS over it, fall back to the node by node evaluation
+// + times Values() of both on a GM block's worth of points
+// + radiance and solar zenith come from synthetic nodes, so no MISR file is needed
+// + exits with 1 if any value differs
+// + build with qmake fusion.pro && make in this directory
+// + usage: fusion-test [runs], best of 10 runs by default
+
+// a GM block at 1.1 km
+static const int s_width = 128;
+static const int s_height = 512;
+static const double s_pixel_size = 1100.0;
+
+// largest relative difference allowed, the fused loop may contract multiplies differently
+static const double s_tolerance = 1e-12;
+
+static double Seconds()
+{
+    timeval now;
+    gettimeofday( & now, 0 );
+    return now.tv_sec + 1e-6 * now.tv_usec;
+}
+
+// a smooth field over the block between base and base + range, with a sprinkling of missing samples
+// + the samples are computed once, so sampling costs about what reading a cached block does
+class syntheticSource : public hdfDataNode
+{
+public:
+
+    syntheticSource( hdfScalar base, hdfScalar range, int phase )
+    :
+    samples( s_width * s_height )
+    {
+        for ( int x = 0 ; x < s_width ; x++ )
+        {
+            for ( int y = 0 ; y < s_height ; y++ )
+            {
+                const bool isMissing = ( x * 31 + y * 17 + phase ) % 23 == 0;
+                const hdfScalar value = base + range * ( 0.5 + 0.5 * sin( phase + 0.013 * x + 0.007 * y ) );
+
+                samples[ x * s_height + y ] = isMissing ? hdfValue( 0, 0 ) : hdfValue( value, 1 );
+            }
+        }
+    }
+
+    virtual hdfValue Value( const hdfCoord & location )
+    {
+        const int x = int( floor( location.x / s_pixel_size ) );
+        const int y = int( floor( location.y / s_pixel_size ) );
+
+        if ( x < 0 || x >= s_width || y < 0 || y >= s_height )
+        {
+            return hdfValue( 0, 0 );
+        }
+
+        return samples[ x * s_height + y ];
+    }
+
+    virtual std::vector<hdfValue> Values( const std::vector<hdfCoord> & location )
+    {
+        std::vector<hdfValue> output( location.size() );
+
+        for ( unsigned int i = 0 ; i < location.size() ; i++ )
+        {
+            output[i] = syntheticSource::Value( location[i] );
+        }
+
+        return output;
+    }
+
+protected:
+
+    std::vector<hdfValue> samples;
+};
+
+// sec( solar zenith ) * scale * radiance, built from plain operator nodes
+static ptr<hdfDataNode> BrfTree( ptr<hdfDataNode> radiance, ptr<hdfDataNode> solarZenith, hdfScalar scale )
+{
+    return new hdfOpBinary<hdfOpBinaryMul>(
+        new hdfOpUnary<hdfOpUnarySecDeg>( solarZenith ),
+        new hdfOpUnary<hdfOpUnaryMul>( radiance, hdfOpUnaryMul( scale ) ) );
+}
+
+// ( brf0 - brf1 ) - ( brf2 - brf3 ), built from plain operator nodes
+static ptr<hdfDataNode> BdasTree( const ptr<hdfDataNode> brf[4] )
+{
+    return new hdfOpBinary<hdfOpBinarySub>(
+        new hdfOpBinary<hdfOpBinarySub>( brf[0], brf[1] ),
+        new hdfOpBinary<hdfOpBinarySub>( brf[2], brf[3] ) );
+}
+
+static bool Same( const hdfValue & a, const hdfValue & b )
+{
+    return fabs( a.x - b.x ) <= s_tolerance * std::max( 1.0, fabs( b.x ) ) && a.y == b.y;
+}
+
+// compares Value() and Values() of a node against a reference, prints and returns the number of differences
+static int Compare( const char * name, ptr<hdfDataNode> node, ptr<hdfDataNode> reference, const std::vector<hdfCoord> & location )
+{
+    std::vector<hdfValue> values = node->Values( location );
+    std::vector<hdfValue> expected = reference->Values( location );
+    int differences = 0;
+
+    for ( unsigned int i = 0 ; i < location.size() ; i++ )
+    {
+        if ( ! Same( values[i], expected[i] ) )
+        {
+            differences++;
+        }
+
+        // every 97th point is also sampled on its own
+        if ( i % 97 == 0 && ! Same( node->Value( location[i] ), expected[i] ) )
+        {
+            differences++;
+        }
+    }
+
+    printf( "  %-26s %s\n", name, differences ? "DIFFERS" : "ok" );
+
+    return differences;
+}
+
+// returns the best time of runs calls to Values() in milliseconds
+static double Time( ptr<hdfDataNode> node, int runs, const std::vector<hdfCoord> & location )
+{
+    double best = 0.0;
+
+    for ( int run = 0 ; run < runs ; run++ )
+    {
+        double start = Seconds();
+        std::vector<hdfValue> values = node->Values( location );
+        double elapsed = 1000.0 * ( Seconds() - start );
+
+        if ( run == 0 || elapsed < best )
+        {
+            best = elapsed;
+        }
+    }
+
+    return best;
+}
+
+int main( int argc, char * argv[] )
+{
+    const int runs = ( argc > 1 ) ? atoi( argv[1] ) : 10;
+
+    // pixel centers of the block, in the column by column order blocks are stored in
+    std::vector<hdfCoord> location;
+
+    for ( int x = 0 ; x < s_width ; x++ )
+    {
+        for ( int y = 0 ; y < s_height ; y++ )
+        {
+            location.push_back( hdfCoord( ( x + 0.5 ) * s_pixel_size, ( y + 0.5 ) * s_pixel_size ) );
+        }
+    }
+
+    // red and blue of two cameras, solar zenith angles up to 80 degrees
+    ptr<hdfDataNode> radiance[4];
+    ptr<hdfDataNode> solarZenith[4];
+    hdfScalar scale[4];
+    ptr<hdfBrfSource> brf[4];
+    ptr<hdfDataNode> brfNodes[4];
+    ptr<hdfDataNode> brfTrees[4];
+
+    for ( int i = 0 ; i < 4 ; i++ )
+    {
+        radiance[i] = new syntheticSource( 10.0, 300.0, 1 + i );
+        solarZenith[i] = new syntheticSource( 20.0, 60.0, 5 + i );
+        scale[i] = 0.002 + 0.0005 * i;
+
+        brf[i] = new hdfBrfSource( radiance[i], solarZenith[i], scale[i] );
+        brfNodes[i] = brf[i];
+        brfTrees[i] = BrfTree( radiance[i], solarZenith[i], scale[i] );
+    }
+
+    ptr<hdfBdasSource> bdas = new hdfBdasSource( brf[0], brf[1], brf[2], brf[3] );
+    ptr<hdfDataNode> bdasTree = BdasTree( brfTrees );
+
+    int differences = 0;
+
+    printf( "%d x %d block\n", s_width, s_height );
+
+    if ( ! brf[0]->IsFused() || ! bdas->IsFused() )
+    {
+        printf( "  new BRF and BDAS are not fused\n" );
+        differences++;
+    }
+
+    differences += Compare( "fused BRF", brf[0], brfTrees[0], location );
+    differences += Compare( "fused BDAS", bdas, bdasTree, location );
+
+    // rewiring the scaled radiance must leave both on the node by node path
+    ptr<hdfBrfSource> rewired = new hdfBrfSource( radiance[3], solarZenith[3], scale[3] );
+    rewired->setInput( 1, new hdfOpUnary<hdfOpUnaryMul>( radiance[3], hdfOpUnaryMul( 2.0 * scale[3] ) ) );
+
+    ptr<hdfBdasSource> rewiredBdas = new hdfBdasSource( brf[0], brf[1], brf[2], rewired );
+    ptr<hdfDataNode> rewiredTrees[4] = { brfTrees[0], brfTrees[1], brfTrees[2], BrfTree( radiance[3], solarZenith[3], 2.0 * scale[3] ) };
+
+    if ( rewired->IsFused() || rewiredBdas->IsFused() )
+    {
+        printf( "  rewired BRF or BDAS is still fused\n" );
+        differences++;
+    }
+
+    differences += Compare( "rewired BRF", rewired, rewiredTrees[3], location );
+    differences += Compare( "BDAS over a rewired BRF", rewiredBdas, BdasTree( rewiredTrees ), location );
+
+    double brfTreeTime = Time( brfTrees[0], runs, location );
+    double brfTime = Time( brfNodes[0], runs, location );
+    double bdasTreeTime = Time( bdasTree, runs, location );
+    double bdasTime = Time( bdas, runs, location );
+
+    printf( "Values(), best of %d runs\n", runs );
+    printf( "  BRF  node by node  %6.2f ms\n", brfTreeTime );
+    printf( "  BRF  fused         %6.2f ms  (%.1fx)\n", brfTime, brfTreeTime / brfTime );
+    printf( "  BDAS node by node  %6.2f ms\n", bdasTreeTime );
+    printf( "  BDAS fused         %6.2f ms  (%.1fx)\n", bdasTime, bdasTreeTime / bdasTime );
+
+    return differences ? 1 : 0;
+}
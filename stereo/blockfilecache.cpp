@@ -0,0 +1,314 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#include "blockfilecache.h"
+#include "config.h"
+#include "hdfField.h"
+
+// identifies block files, changed whenever the header or layout changes
+static const char s_block_magic[8] = "MISRBLK";
+static const int s_block_version = 1;
+
+// block data starts on a page boundary, so reading it straight into a block buffer stays aligned
+static const long s_block_data_offset = 4096;
+
+// default size of the cache directory in megabytes
+static const double s_block_cache_mb = 4096.0;
+
+// a trim leaves this part of the budget in use, so the next ones are a while off
+static const double s_trim_fraction = 0.75;
+
+blockFileCache::blockFileCache( const std::string & theDirectory, long long theMaxBytes )
+:
+directory( theDirectory ),
+enabled( false ),
+maxBytes( theMaxBytes ),
+cachedBytes( 0 ),
+sizeLock()
+{
+    if ( directory.empty() || maxBytes <= 0 )
+    {
+        return;
+    }
+
+    if ( mkdir( directory.c_str(), 0775 ) != 0 && errno != EEXIST )
+    {
+        printf( "Block cache disabled, can not create %s\n", directory.c_str() );
+        return;
+    }
+
+    enabled = ( access( directory.c_str(), R_OK | W_OK | X_OK ) == 0 );
+
+    if ( enabled )
+    {
+        // counts what earlier runs left, and trims it if the budget shrank
+        Trim();
+    }
+}
+
+blockFileCache & blockFileCache::Default()
+{
+    static blockFileCache cache( getenv( "MISR_BLOCK_CACHE_DIR" ) ? getenv( "MISR_BLOCK_CACHE_DIR" ) : PACKAGE_DATA_DIR "/cache",
+                                 ( long long ) ( ( getenv( "MISR_BLOCK_CACHE_MB" ) ? atof( getenv( "MISR_BLOCK_CACHE_MB" ) ) : s_block_cache_mb ) * 1024.0 * 1024.0 ) );
+    return cache;
+}
+
+bool blockFileCache::IsEnabled() const
+{
+    return enabled;
+}
+
+bool blockFileCache::Load( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims, void * dest ) const
+{
+    header expected;
+    if ( ! enabled || ! MakeHeader( field, blockIndex, dims, expected ) )
+    {
+        return false;
+    }
+
+    int file = open( FilePath( field, blockIndex, dims ).c_str(), O_RDONLY );
+    if ( file < 0 )
+    {
+        return false;
+    }
+
+    const long blockBytes = field.BlockMemSize();
+    const long fileBytes = s_block_data_offset + blockBytes;
+    bool found = false;
+
+    // the block is read straight into dest, a mapping would only add a copy out of it
+    struct stat info;
+    header stored;
+    if ( fstat( file, & info ) == 0 && info.st_size == fileBytes
+        && pread( file, & stored, sizeof( header ), 0 ) == long( sizeof( header ) )
+        && memcmp( & stored, & expected, sizeof( header ) ) == 0
+        && pread( file, dest, blockBytes, s_block_data_offset ) == blockBytes )
+    {
+        // the modification time orders blocks for eviction, so a block in use is kept
+        futimens( file, 0 );
+        found = true;
+    }
+
+    close( file );
+    return found;
+}
+
+void blockFileCache::Store( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims, const void * source ) const
+{
+    header contents;
+    if ( ! enabled || ! MakeHeader( field, blockIndex, dims, contents ) )
+    {
+        return;
+    }
+
+    // write to a file of our own, then move it into place in one step
+    const std::string path = FilePath( field, blockIndex, dims );
+    std::ostringstream temporary;
+    temporary << path << ".tmp." << getpid() << "." << std::this_thread::get_id();
+
+    int file = open( temporary.str().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0664 );
+    if ( file < 0 )
+    {
+        return;
+    }
+
+    std::vector<char> head( s_block_data_offset, 0 );
+    memcpy( & head[0], & contents, sizeof( header ) );
+
+    const long blockBytes = field.BlockMemSize();
+    bool written = ( write( file, & head[0], head.size() ) == long( head.size() ) )
+        && ( write( file, source, blockBytes ) == blockBytes );
+
+    written = ( close( file ) == 0 ) && written;
+
+    if ( ! written || rename( temporary.str().c_str(), path.c_str() ) != 0 )
+    {
+        unlink( temporary.str().c_str() );
+        return;
+    }
+
+    bool full = false;
+    {
+        std::lock_guard<std::mutex> guard( sizeLock );
+
+        // a replaced file is counted twice until the next trim recounts
+        cachedBytes += s_block_data_offset + blockBytes;
+        full = ( cachedBytes > maxBytes );
+    }
+
+    if ( full )
+    {
+        Trim();
+    }
+}
+
+bool blockFileCache::MakeHeader( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims, header & expected ) const
+{
+    // blocks of a changed source file must not be used
+    struct stat info;
+    if ( dims.size() > 8 || stat( field.FileName().c_str(), & info ) != 0 )
+    {
+        return false;
+    }
+
+    memset( & expected, 0, sizeof( header ) );
+    memcpy( expected.magic, s_block_magic, sizeof( expected.magic ) );
+    expected.version = s_block_version;
+    expected.dataType = field.DataType();
+    expected.dataSize = field.DataSize();
+    expected.xDim = field.XDim();
+    expected.yDim = field.YDim();
+    expected.blockIndex = blockIndex;
+    expected.numDims = int( dims.size() );
+    for ( unsigned int i = 0 ; i < dims.size() ; i++ )
+    {
+        expected.dims[i] = dims[i];
+    }
+    memcpy( expected.fillValue, field.FillValue(), sizeof( expected.fillValue ) );
+    expected.scale = field.Scale();
+    expected.sourceSize = info.st_size;
+    expected.sourceTime = info.st_mtime;
+    strncpy( expected.fileName, field.FileName().c_str(), sizeof( expected.fileName ) - 1 );
+    strncpy( expected.gridName, field.GridName().c_str(), sizeof( expected.gridName ) - 1 );
+    strncpy( expected.fieldName, field.Name().c_str(), sizeof( expected.fieldName ) - 1 );
+
+    return true;
+}
+
+std::string blockFileCache::FilePath( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims ) const
+{
+    std::string fileName = field.FileName();
+    size_t slash = fileName.rfind( '/' );
+    if ( slash != std::string::npos )
+    {
+        fileName = fileName.substr( slash + 1 );
+    }
+
+    std::ostringstream path;
+    path << fileName << "." << field.GridName() << "." << field.Name();
+    for ( unsigned int i = 0 ; i < dims.size() ; i++ )
+    {
+        path << "." << dims[i];
+    }
+    path << "." << blockIndex;
+
+    // field names such as "Red Radiance/RDQI" are not valid file names
+    std::string name = path.str();
+    for ( unsigned int i = 0 ; i < name.size() ; i++ )
+    {
+        if ( name[i] == '/' || name[i] == ' ' )
+        {
+            name[i] = '_';
+        }
+    }
+
+    return directory + "/" + name;
+}
+
+bool blockFileCache::IsBlockFile( const char * name, const std::string & path )
+{
+    // files still being written belong to their writer
+    if ( name[0] == '.' || strstr( name, ".tmp." ) )
+    {
+        return false;
+    }
+
+    // file, grid and field names, then the block index
+    const char * index = strrchr( name, '.' );
+    int dots = 0;
+    for ( const char * c = name ; *c ; c++ )
+    {
+        dots += ( *c == '.' );
+    }
+
+    if ( dots < 3 || ! index[1] || strspn( index + 1, "0123456789" ) != strlen( index + 1 ) )
+    {
+        return false;
+    }
+
+    int file = open( path.c_str(), O_RDONLY );
+    if ( file < 0 )
+    {
+        return false;
+    }
+
+    char magic[ sizeof( s_block_magic ) ];
+    bool isBlock = ( pread( file, magic, sizeof( magic ), 0 ) == long( sizeof( magic ) ) )
+        && memcmp( magic, s_block_magic, sizeof( magic ) ) == 0;
+
+    close( file );
+    return isBlock;
+}
+
+void blockFileCache::Trim() const
+{
+    std::lock_guard<std::mutex> guard( sizeLock );
+
+    // another thread trimmed while this one waited
+    if ( cachedBytes > 0 && cachedBytes <= maxBytes )
+    {
+        return;
+    }
+
+    DIR * dir = opendir( directory.c_str() );
+    if ( ! dir )
+    {
+        return;
+    }
+
+    struct blockFile
+    {
+        time_t time;
+        long long bytes;
+        std::string path;
+
+        bool operator < ( const blockFile & other ) const { return time < other.time; }
+    };
+
+    std::vector<blockFile> files;
+    long long total = 0;
+
+    for ( struct dirent * entry = readdir( dir ) ; entry ; entry = readdir( dir ) )
+    {
+        blockFile file;
+        file.path = directory + "/" + entry->d_name;
+
+        struct stat info;
+        if ( stat( file.path.c_str(), & info ) != 0 || ! S_ISREG( info.st_mode ) || ! IsBlockFile( entry->d_name, file.path ) )
+        {
+            continue;
+        }
+
+        file.time = info.st_mtime;
+        file.bytes = info.st_size;
+        total += file.bytes;
+        files.push_back( file );
+    }
+
+    closedir( dir );
+
+    if ( total > maxBytes )
+    {
+        std::sort( files.begin(), files.end() );
+
+        const long long target = ( long long ) ( s_trim_fraction * maxBytes );
+        for ( unsigned int i = 0 ; i < files.size() && total > target ; i++ )
+        {
+            // another process may have removed or replaced it already, it is gone from the count either way
+            unlink( files[i].path.c_str() );
+            total -= files[i].bytes;
+        }
+    }
+
+    cachedBytes = total;
+}
@@ -0,0 +1,80 @@
+#ifndef BLOCKFILECACHE_H_INCLUDED
+#define BLOCKFILECACHE_H_INCLUDED
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+class hdfFieldNode;
+
+// blockFileCache
+// + keeps decoded field blocks in a directory, one uncompressed file per block
+// + files are replaced atomically, so several processes can fill the cache at once
+// + a block is read again from hdf if its file was written for a different source file
+// + the files are kept within a byte budget, loading a block touches its file and the least recently touched go first
+// + the directory is $MISR_BLOCK_CACHE_DIR, or PACKAGE_DATA_DIR/cache, an empty value turns the cache off
+// + the budget is $MISR_BLOCK_CACHE_MB megabytes, 0 turns the cache off
+class blockFileCache
+{
+public:
+
+    blockFileCache( const std::string & theDirectory, long long theMaxBytes );
+
+    // returns the cache shared by all fields
+    static blockFileCache & Default();
+
+    // returns false if the directory can not be used
+    bool IsEnabled() const;
+
+    // copies a cached block into dest, returns false if the block is not cached
+    bool Load( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims, void * dest ) const;
+
+    // writes a block to the cache
+    void Store( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims, const void * source ) const;
+
+protected:
+
+    // describes the data in a block file, the block data starts at s_block_data_offset
+    struct header
+    {
+        char magic[8];
+        int version;
+        int dataType;
+        int dataSize;
+        int xDim;
+        int yDim;
+        int blockIndex;
+        int numDims;
+        int dims[8];
+        unsigned char fillValue[8];
+        double scale;
+        long long sourceSize;
+        long long sourceTime;
+        char fileName[256];
+        char gridName[64];
+        char fieldName[64];
+    };
+
+    // fills in the header a block file must have, returns false if the block can not be cached
+    bool MakeHeader( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims, header & expected ) const;
+
+    // returns the path of the file for a block
+    std::string FilePath( const hdfFieldNode & field, int blockIndex, const std::vector<int> & dims ) const;
+
+    // returns true if a file in the directory is a block file, named the way FilePath names them and starting with the block header
+    // anything else in the directory is not the cache's to count or delete
+    static bool IsBlockFile( const char * name, const std::string & path );
+
+    // deletes the least recently used block files until the cache is well within budget, and recounts its size
+    void Trim() const;
+
+    std::string directory;
+    bool enabled;
+    long long maxBytes;
+
+    // bytes in the directory as of the last Trim, plus the files stored since
+    mutable long long cachedBytes;
+    mutable std::mutex sizeLock;
+};
+
+#endif // BLOCKFILECACHE_H_INCLUDED
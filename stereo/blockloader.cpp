@@ -0,0 +1,298 @@
+#include <algorithm>
+
+#include "glutaux.h"
+#include "blockloader.h"
+#include "viewport.h"
+
+// most blocks of a stereo pair read and colorized by one worker at a time
+static const int s_max_batch_blocks = 8;
+
+blockLoader::blockLoader( double cacheBytes, int numThreads )
+:
+working( 0 ),
+generation( 0 ),
+stopping( false ),
+cache( cacheBytes )
+{
+    if ( numThreads < 1 )
+    {
+        // leave one core to the opengl thread
+        numThreads = int( std::thread::hardware_concurrency() ) - 1;
+        numThreads = max( numThreads, 1 );
+    }
+
+    for ( int i = 0 ; i < numThreads ; i++ )
+    {
+        workers.push_back( std::thread( &blockLoader::Run, this ) );
+    }
+}
+
+blockLoader::~blockLoader()
+{
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        stopping = true;
+        queue.clear();
+    }
+
+    wake.notify_all();
+
+    for ( unsigned int i = 0 ; i < workers.size() ; i++ )
+    {
+        workers[i].join();
+    }
+}
+
+int blockLoader::NumThreads() const
+{
+    return int( workers.size() );
+}
+
+void blockLoader::Submit( const request & newRequest )
+{
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        queue.push_back( newRequest );
+        queue.back().generation = generation;
+        std::push_heap( queue.begin(), queue.end(), LaterRequest );
+    }
+
+    wake.notify_one();
+}
+
+void blockLoader::Cancel()
+{
+    std::lock_guard<std::mutex> guard( lock );
+    generation++;
+    queue.clear();
+    finished.clear();
+}
+
+void blockLoader::Unqueue( std::vector<request> & unqueued )
+{
+    std::lock_guard<std::mutex> guard( lock );
+    unqueued.insert( unqueued.end(), queue.begin(), queue.end() );
+    queue.clear();
+}
+
+int blockLoader::NumPending() const
+{
+    std::lock_guard<std::mutex> guard( lock );
+    return int( queue.size() ) + working;
+}
+
+bool blockLoader::Collect( result & output )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    if ( finished.empty() )
+    {
+        return false;
+    }
+
+    output.source = finished.front().source;
+    output.image1.swap( finished.front().image1 );
+    output.image2.swap( finished.front().image2 );
+    finished.pop_front();
+
+    return true;
+}
+
+void blockLoader::Run()
+{
+    // per thread scratch space for both eyes, three channels per block, reused for every batch
+    std::vector< matrix<unsigned short> > channels1;
+    std::vector< matrix<unsigned short> > channels2;
+    std::vector<request> batch;
+    result output;
+
+    std::unique_lock<std::mutex> guard( lock );
+
+    while ( ! stopping )
+    {
+        if ( queue.empty() )
+        {
+            wake.wait( guard );
+            continue;
+        }
+
+        TakeBatch( batch );
+        working += int( batch.size() );
+
+        guard.unlock();
+
+        const int blockMin = batch.front().blockIndex;
+        const int blockMax = batch.back().blockIndex;
+
+        channels1.resize( 3 * batch.size() );
+        channels2.resize( 3 * batch.size() );
+
+        if ( batch.front().v1 )
+        {
+            ReadBlocks( batch.front().v1, blockMin, blockMax, &channels1[0] );
+        }
+
+        if ( batch.front().v2 )
+        {
+            ReadBlocks( batch.front().v2, blockMin, blockMax, &channels2[0] );
+        }
+
+        for ( unsigned int b = 0 ; b < batch.size() ; b++ )
+        {
+            const request & current = batch[b];
+            const matrix<unsigned short> * blockChannels1 = &channels1[ 3 * b ];
+            const matrix<unsigned short> * blockChannels2 = &channels2[ 3 * b ];
+
+            output.source = current;
+
+            if ( current.v1 && current.v2 )
+            {
+                // eyes of different resolutions are colorized and masked separately
+                if ( ! viewport::ColorizePair( *current.v1, blockChannels1, *current.v2, blockChannels2, current.maxVal, output.image1, output.image2 ) )
+                {
+                    current.v1->Colorize( blockChannels1, current.maxVal, output.image1 );
+                    current.v2->Colorize( blockChannels2, current.maxVal, output.image2 );
+                    MaskStereoPair( output.image1, output.image2 );
+                }
+            }
+            else if ( current.v1 )
+            {
+                current.v1->Colorize( blockChannels1, current.maxVal, output.image1 );
+            }
+            else if ( current.v2 )
+            {
+                current.v2->Colorize( blockChannels2, current.maxVal, output.image2 );
+            }
+
+            guard.lock();
+
+            working--;
+
+            // drop blocks that were cancelled while being decoded
+            if ( current.generation == generation )
+            {
+                finished.push_back( result() );
+                finished.back().source = current;
+                finished.back().image1.swap( output.image1 );
+                finished.back().image2.swap( output.image2 );
+            }
+
+            guard.unlock();
+        }
+
+        guard.lock();
+    }
+}
+
+void blockLoader::TakeBatch( std::vector<request> & batch )
+{
+    std::pop_heap( queue.begin(), queue.end(), LaterRequest );
+    batch.assign( 1, queue.back() );
+    queue.pop_back();
+
+    // grow the batch with queued neighbours of the same pair, so the blocks are read in one range
+    bool grown = true;
+
+    while ( grown && int( batch.size() ) < s_max_batch_blocks )
+    {
+        grown = false;
+
+        for ( unsigned int i = 0 ; i < queue.size() ; i++ )
+        {
+            const request & candidate = queue[i];
+
+            if ( candidate.v1 != batch.front().v1 || candidate.v2 != batch.front().v2
+                || candidate.maxVal != batch.front().maxVal || candidate.generation != batch.front().generation )
+            {
+                continue;
+            }
+
+            if ( candidate.blockIndex == batch.front().blockIndex - 1 )
+            {
+                batch.insert( batch.begin(), candidate );
+            }
+            else if ( candidate.blockIndex == batch.back().blockIndex + 1 )
+            {
+                batch.push_back( candidate );
+            }
+            else
+            {
+                continue;
+            }
+
+            queue[i] = queue.back();
+            queue.pop_back();
+            grown = true;
+            break;
+        }
+    }
+
+    if ( batch.size() > 1 )
+    {
+        std::make_heap( queue.begin(), queue.end(), LaterRequest );
+    }
+}
+
+void blockLoader::ReadBlocks( const viewport * source, int blockMin, int blockMax, matrix<unsigned short> * channels )
+{
+    std::vector<bool> cached( blockMax - blockMin + 1 );
+
+    for ( int block = blockMin ; block <= blockMax ; block++ )
+    {
+        cached[ block - blockMin ] = cache.Find( source, block, &channels[ 3 * ( block - blockMin ) ] );
+    }
+
+    // read each run of blocks missing from the cache at once
+    for ( int first = blockMin ; first <= blockMax ; )
+    {
+        if ( cached[ first - blockMin ] )
+        {
+            first++;
+            continue;
+        }
+
+        int last = first;
+        while ( last < blockMax && ! cached[ last + 1 - blockMin ] )
+        {
+            last++;
+        }
+
+        source->ReadBlocks( first, last, &channels[ 3 * ( first - blockMin ) ] );
+
+        for ( int block = first ; block <= last ; block++ )
+        {
+            cache.Insert( source, block, &channels[ 3 * ( block - blockMin ) ] );
+        }
+
+        first = last + 1;
+    }
+}
+
+bool blockLoader::LaterRequest( const request & a, const request & b )
+{
+    return a.priority > b.priority;
+}
+
+void blockLoader::MaskStereoPair( std::vector<unsigned char> & image1, std::vector<unsigned char> & image2 )
+{
+    unsigned char * pixel1 = & image1[0];
+    unsigned char * pixel2 = & image2[0];
+    unsigned char * pixel1end = pixel1 + min( image1.size(), image2.size() );
+
+    while ( pixel1 < pixel1end )
+    {
+        if ( pixel1[3] == 0 || pixel2[3] == 0 )
+        {
+            pixel1[0] = 0;
+            pixel1[1] = 0;
+            pixel1[2] = 0;
+
+            pixel2[0] = 0;
+            pixel2[1] = 0;
+            pixel2[2] = 0;
+        }
+
+        pixel1 += 4;
+        pixel2 += 4;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef BLOCKLOADER_H_INCLUDED
+#define BLOCKLOADER_H_INCLUDED
+
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "radiancecache.h"
+
+class viewport;
+
+// blockLoader
+// + reads and colorizes the blocks of a stereo pair on worker threads
+// + the opengl thread only collects finished RGBA images and uploads them
+// + raw radiance stays cached so a stretch change only colorizes again
+// + queued neighbouring blocks are read together, one hdf read per range
+class blockLoader
+{
+public:
+
+    // a block of a stereo pair waiting to be decoded
+    // + requests with a lower priority value are decoded first
+    struct request
+    {
+        int view;
+        int blockIndex;
+        viewport *v1;
+        viewport *v2;
+        double maxVal;
+        double priority;
+        unsigned generation;
+    };
+
+    // RGBA images of both eyes for a decoded block
+    struct result
+    {
+        request source;
+        std::vector<unsigned char> image1;
+        std::vector<unsigned char> image2;
+    };
+
+    // starts numThreads workers, or one for each spare core if numThreads < 1
+    // + cacheBytes limits the memory used to keep raw radiance of read blocks
+    blockLoader( double cacheBytes, int numThreads = 0 );
+
+    // stops and joins all workers
+    ~blockLoader();
+
+    // returns the number of worker threads
+    int NumThreads() const;
+
+    // queues a block for decoding
+    void Submit( const request & newRequest );
+
+    // removes the requests that have not been started yet and appends them to unqueued
+    // + requests in progress still finish
+    void Unqueue( std::vector<request> & unqueued );
+
+    // drops all queued requests and discards requests already in progress
+    void Cancel();
+
+    // returns the number of requests queued or in progress
+    int NumPending() const;
+
+    // moves the oldest finished block into output, returns false if none is ready
+    bool Collect( result & output );
+
+protected:
+
+    // worker thread main loop
+    void Run();
+
+    // takes the top request and queued neighbouring blocks of the same pair, in block order
+    // + the lock must be held
+    void TakeBatch( std::vector<request> & batch );
+
+    // reads blocks from the radiance cache, and runs of cache misses from the file in one read
+    // + channels holds 3 buffers per block, in block order
+    void ReadBlocks( const viewport * source, int blockMin, int blockMax, matrix<unsigned short> * channels );
+
+    // orders the queue so the request with the lowest priority value is on top
+    static bool LaterRequest( const request & a, const request & b );
+
+    // blacks out pixels that are not valid in both eyes
+    static void MaskStereoPair( std::vector<unsigned char> & image1, std::vector<unsigned char> & image2 );
+
+    mutable std::mutex lock;
+    std::condition_variable wake;
+
+    std::vector<request> queue;
+    std::list<result> finished;
+
+    int working;
+    unsigned generation;
+    bool stopping;
+
+    radianceCache cache;
+
+    std::vector<std::thread> workers;
+};
+
+#endif // BLOCKLOADER_H_INCLUDED
@@ -0,0 +1,308 @@
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "blockrenderer.h"
+#include "glextensions.h"
+
+#ifndef GL_TEXTURE_2D_ARRAY
+# define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+
+// two triangles per block
+static const int s_vertices_per_block = 6;
+
+// x, y in world coordinates, then s, t and the block's layer
+static const int s_floats_per_vertex = 5;
+
+// attribute locations, position takes 0 so it stands in for glVertex
+static const GLuint s_position_attribute = 0;
+static const GLuint s_texcoord_attribute = 1;
+
+#ifdef GLEXTENSIONS_LOADED
+
+static const char * s_vertex_shader =
+    "#version 130\n"
+    "in vec2 position;\n"
+    "in vec3 texCoord;\n"
+    "out vec3 blockCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    blockCoord = texCoord;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4( position, 0.0, 1.0 );\n"
+    "}\n";
+
+static const char * s_fragment_shader =
+    "#version 130\n"
+    "uniform sampler2DArray blocks;\n"
+    "in vec3 blockCoord;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = texture( blocks, blockCoord );\n"
+    "}\n";
+
+// compiles one shader, returns 0 and prints the log if it fails
+static GLuint CompileShader( GLenum type, const char * source )
+{
+    const glExtensions & gl = GLExtensions();
+
+    GLuint shader = gl.createShader( type );
+    gl.shaderSource( shader, 1, & source, 0 );
+    gl.compileShader( shader );
+
+    GLint compiled = GL_FALSE;
+    gl.getShaderiv( shader, GL_COMPILE_STATUS, & compiled );
+    if ( ! compiled )
+    {
+        char log[1024] = "";
+        gl.getShaderInfoLog( shader, sizeof( log ), 0, log );
+        printf( "Block shader did not compile, drawing blocks one by one\n%s\n", log );
+        gl.deleteShader( shader );
+        return 0;
+    }
+
+    return shader;
+}
+
+#endif // GLEXTENSIONS_LOADED
+
+blockRenderer::blockRenderer()
+:
+minBlock( 0 ),
+maxBlock( -1 ),
+vertexBuffer( 0 ),
+vertices(),
+runFirst(),
+runCount()
+{
+
+}
+
+bool blockRenderer::IsSupported()
+{
+#ifdef GLEXTENSIONS_LOADED
+    return GLExtensions().arrayTextures && Program() != 0;
+#else
+    return false;
+#endif
+}
+
+GLuint blockRenderer::Program()
+{
+    static GLuint program = 0;
+
+#ifdef GLEXTENSIONS_LOADED
+    static bool built = false;
+
+    if ( built )
+    {
+        return program;
+    }
+
+    built = true;
+
+    const glExtensions & gl = GLExtensions();
+
+    GLuint vertexShader = CompileShader( GL_VERTEX_SHADER, s_vertex_shader );
+    GLuint fragmentShader = CompileShader( GL_FRAGMENT_SHADER, s_fragment_shader );
+
+    if ( vertexShader && fragmentShader )
+    {
+        program = gl.createProgram();
+        gl.attachShader( program, vertexShader );
+        gl.attachShader( program, fragmentShader );
+        gl.bindAttribLocation( program, s_position_attribute, "position" );
+        gl.bindAttribLocation( program, s_texcoord_attribute, "texCoord" );
+        gl.linkProgram( program );
+
+        GLint linked = GL_FALSE;
+        gl.getProgramiv( program, GL_LINK_STATUS, & linked );
+        if ( linked )
+        {
+            gl.useProgram( program );
+            gl.uniform1i( gl.getUniformLocation( program, "blocks" ), 0 );
+            gl.useProgram( 0 );
+        }
+        else
+        {
+            char log[1024] = "";
+            gl.getProgramInfoLog( program, sizeof( log ), 0, log );
+            printf( "Block shader did not link, drawing blocks one by one\n%s\n", log );
+            gl.deleteProgram( program );
+            program = 0;
+        }
+    }
+
+    // the program keeps what it needs of the shaders
+    if ( vertexShader ) gl.deleteShader( vertexShader );
+    if ( fragmentShader ) gl.deleteShader( fragmentShader );
+#endif
+
+    return program;
+}
+
+void blockRenderer::Alloc( int theMinBlock, int theMaxBlock, const std::vector<hdfRect> & rects )
+{
+    Destroy();
+
+#ifdef GLEXTENSIONS_LOADED
+    minBlock = theMinBlock;
+    maxBlock = theMaxBlock;
+
+    vertices.clear();
+    vertices.reserve( rects.size() * s_vertices_per_block * s_floats_per_vertex );
+
+    for ( unsigned int i = 0 ; i < rects.size() ; i++ )
+    {
+        const hdfRect & rect = rects[i];
+
+        // blocks get their layers as they are uploaded
+        const float layer = 0;
+
+        // corners in the order DrawBlock used for its triangle strip
+        const float corner[4][4] =
+        {
+            { float( rect.Left() ),  float( rect.Top() ),    0, 0 },
+            { float( rect.Right() ), float( rect.Top() ),    1, 0 },
+            { float( rect.Left() ),  float( rect.Bottom() ), 0, 1 },
+            { float( rect.Right() ), float( rect.Bottom() ), 1, 1 }
+        };
+        const int triangles[ s_vertices_per_block ] = { 0, 1, 2, 1, 3, 2 };
+
+        for ( int v = 0 ; v < s_vertices_per_block ; v++ )
+        {
+            const float * c = corner[ triangles[v] ];
+            vertices.push_back( c[0] );
+            vertices.push_back( c[1] );
+            vertices.push_back( c[2] );
+            vertices.push_back( c[3] );
+            vertices.push_back( layer );
+        }
+    }
+
+    const glExtensions & gl = GLExtensions();
+
+    gl.genBuffers( 1, & vertexBuffer );
+    gl.bindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+    gl.bufferData( GL_ARRAY_BUFFER, GLsizeiptr( vertices.size() * sizeof( float ) ), vertices.empty() ? 0 : & vertices[0], GL_STATIC_DRAW );
+    gl.bindBuffer( GL_ARRAY_BUFFER, 0 );
+#else
+    ( void ) theMinBlock;
+    ( void ) theMaxBlock;
+    ( void ) rects;
+#endif
+}
+
+void blockRenderer::Destroy()
+{
+#ifdef GLEXTENSIONS_LOADED
+    if ( vertexBuffer )
+    {
+        GLExtensions().deleteBuffers( 1, & vertexBuffer );
+    }
+#endif
+
+    vertexBuffer = 0;
+    vertices.clear();
+    minBlock = 0;
+    maxBlock = -1;
+}
+
+void blockRenderer::setLayer( int blockIndex, int layer )
+{
+#ifdef GLEXTENSIONS_LOADED
+    if ( ! vertexBuffer || blockIndex < minBlock || blockIndex > maxBlock )
+    {
+        return;
+    }
+
+    const int first = ( blockIndex - minBlock ) * s_vertices_per_block * s_floats_per_vertex;
+    const int count = s_vertices_per_block * s_floats_per_vertex;
+
+    if ( vertices[ first + s_floats_per_vertex - 1 ] == float( layer ) )
+    {
+        return;
+    }
+
+    for ( int v = 0 ; v < s_vertices_per_block ; v++ )
+    {
+        vertices[ first + v * s_floats_per_vertex + s_floats_per_vertex - 1 ] = float( layer );
+    }
+
+    const glExtensions & gl = GLExtensions();
+
+    gl.bindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+    gl.bufferSubData( GL_ARRAY_BUFFER, GLintptr( first * sizeof( float ) ), GLsizeiptr( count * sizeof( float ) ), & vertices[ first ] );
+    gl.bindBuffer( GL_ARRAY_BUFFER, 0 );
+#else
+    ( void ) blockIndex;
+    ( void ) layer;
+#endif
+}
+
+void blockRenderer::Draw( const blockTextures & textures, int firstBlock, int lastBlock, const std::vector<bool> & drawn ) const
+{
+#ifdef GLEXTENSIONS_LOADED
+    if ( ! vertexBuffer || textures.NumPages() == 0 )
+    {
+        return;
+    }
+
+    const glExtensions & gl = GLExtensions();
+    const GLsizei stride = s_floats_per_vertex * sizeof( float );
+
+    gl.useProgram( Program() );
+
+    gl.bindBuffer( GL_ARRAY_BUFFER, vertexBuffer );
+    gl.vertexAttribPointer( s_position_attribute, 2, GL_FLOAT, GL_FALSE, stride, ( const GLvoid * ) 0 );
+    gl.vertexAttribPointer( s_texcoord_attribute, 3, GL_FLOAT, GL_FALSE, stride, ( const GLvoid * ) ( 2 * sizeof( float ) ) );
+    gl.enableVertexAttribArray( s_position_attribute );
+    gl.enableVertexAttribArray( s_texcoord_attribute );
+
+    for ( int page = 0 ; page < textures.NumPages() ; page++ )
+    {
+        // gather runs of drawn blocks in this page, neighbours usually share a page as they load together
+        runFirst.clear();
+        runCount.clear();
+
+        for ( int block = std::max( firstBlock, minBlock ) ; block <= std::min( lastBlock, maxBlock ) ; block++ )
+        {
+            if ( ! drawn[ block ] || ! textures.IsResident( block ) || textures.Page( block ) != page )
+            {
+                continue;
+            }
+
+            const GLint first = ( block - minBlock ) * s_vertices_per_block;
+
+            if ( ! runFirst.empty() && runFirst.back() + runCount.back() == first )
+            {
+                runCount.back() += s_vertices_per_block;
+            }
+            else
+            {
+                runFirst.push_back( first );
+                runCount.push_back( s_vertices_per_block );
+            }
+        }
+
+        if ( runFirst.empty() )
+        {
+            continue;
+        }
+
+        glBindTexture( GL_TEXTURE_2D_ARRAY, textures.PageTexture( page ) );
+        gl.multiDrawArrays( GL_TRIANGLES, & runFirst[0], & runCount[0], GLsizei( runFirst.size() ) );
+    }
+
+    gl.disableVertexAttribArray( s_texcoord_attribute );
+    gl.disableVertexAttribArray( s_position_attribute );
+    gl.bindBuffer( GL_ARRAY_BUFFER, 0 );
+
+    gl.useProgram( 0 );
+#else
+    ( void ) textures;
+    ( void ) firstBlock;
+    ( void ) lastBlock;
+    ( void ) drawn;
+#endif
+}
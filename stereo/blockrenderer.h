@@ -0,0 +1,55 @@
+#ifndef BLOCKRENDERER_H_INCLUDED
+#define BLOCKRENDERER_H_INCLUDED
+
+#include <vector>
+
+#include "blocktextures.h"
+#include "glutaux.h"
+#include "hdfBase.h"
+
+// blockRenderer
+// + draws the blocks of an orbit from a vertex buffer of block quads in world coordinates, built once per orbit
+// + each vertex carries its block's layer, and a shader samples that layer of the page holding the block,
+//   so the blocks of an eye draw in one call per page without binding a texture per block
+// + a block's layer is written into the vertex buffer when it changes, blocks can move between layers and pages
+// + needs OpenGL 3.0, check IsSupported() before allocating
+class blockRenderer
+{
+public:
+
+    blockRenderer();
+
+    // returns true if the context can draw blocks this way, builds the shader the first time
+    static bool IsSupported();
+
+    // builds the vertex buffer for blocks minBlock to maxBlock, rects holds their rectangles in block order
+    void Alloc( int minBlock, int maxBlock, const std::vector<hdfRect> & rects );
+
+    // releases the vertex buffer
+    void Destroy();
+
+    // points the vertices of a block at a layer of its page
+    void setLayer( int blockIndex, int layer );
+
+    // draws blocks firstBlock to lastBlock for which drawn is set, each from its layer of the pages of textures
+    void Draw( const blockTextures & textures, int firstBlock, int lastBlock, const std::vector<bool> & drawn ) const;
+
+protected:
+
+    // returns the shader program shared by all renderers, 0 if it could not be built
+    static GLuint Program();
+
+    int minBlock;
+    int maxBlock;
+
+    GLuint vertexBuffer;
+
+    // copy of the vertex buffer, to tell whether a block's layer changed
+    std::vector<float> vertices;
+
+    // runs of consecutive drawn blocks, kept to draw without allocating
+    mutable std::vector<GLint> runFirst;
+    mutable std::vector<GLsizei> runCount;
+};
+
+#endif // BLOCKRENDERER_H_INCLUDED
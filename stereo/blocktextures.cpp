@@ -0,0 +1,421 @@
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "blocktextures.h"
+#include "glextensions.h"
+
+// staging buffers in the upload ring, enough that a buffer's previous copy has finished when it comes round again
+static const int s_pixel_buffer_count = 4;
+
+// most layers of an array texture page, 64 MiB of 512 x 2048 blocks
+static const int s_page_layers = 16;
+
+#ifndef GL_TEXTURE_2D_ARRAY
+# define GL_TEXTURE_2D_ARRAY 0x8C1A
+#endif
+
+blockTextures::blockTextures()
+:
+minBlock( 0 ),
+width( 0 ),
+height( 0 ),
+maxResident( 0 ),
+numResident( 0 ),
+textures(),
+spareTextures(),
+arrayMode( false ),
+pages(),
+pageLayers(),
+blockLayer(),
+spareLayers(),
+nextLayer( 0 ),
+pixelBuffers(),
+nextPixelBuffer( 0 )
+{
+
+}
+
+void blockTextures::Alloc( int theMinBlock, int maxBlock, int theWidth, int theHeight, int theMaxResident, bool asArray )
+{
+    Destroy();
+
+    minBlock = theMinBlock;
+    width = theWidth;
+    height = theHeight;
+
+    const int numBlocks = maxBlock - minBlock + 1;
+
+    maxResident = std::max( 0, std::min( theMaxResident, numBlocks ) );
+    numResident = 0;
+
+#ifdef GLEXTENSIONS_LOADED
+    const glExtensions & gl = GLExtensions();
+
+    arrayMode = asArray && gl.arrayTextures;
+#else
+    ( void ) asArray;
+#endif
+
+    if ( arrayMode )
+    {
+        blockLayer.assign( numBlocks, -1 );
+    }
+    else
+    {
+        textures.assign( numBlocks, 0 );
+    }
+
+    // textures are drawn as they are, the globe drawn after the blocks relies on this too
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+
+#ifdef GLEXTENSIONS_LOADED
+    if ( gl.pixelBuffers )
+    {
+        pixelBuffers.resize( s_pixel_buffer_count );
+        gl.genBuffers( s_pixel_buffer_count, & pixelBuffers[0] );
+        nextPixelBuffer = 0;
+    }
+#endif
+}
+
+void blockTextures::Destroy()
+{
+    for ( unsigned int i = 0 ; i < textures.size() ; i++ )
+    {
+        if ( textures[i] )
+        {
+            spareTextures.push_back( textures[i] );
+        }
+    }
+
+    if ( ! spareTextures.empty() )
+    {
+        glDeleteTextures( GLsizei( spareTextures.size() ), & spareTextures[0] );
+    }
+
+    textures.clear();
+    spareTextures.clear();
+
+    if ( ! pages.empty() )
+    {
+        glDeleteTextures( GLsizei( pages.size() ), & pages[0] );
+    }
+
+    pages.clear();
+    pageLayers.clear();
+    blockLayer.clear();
+    spareLayers.clear();
+    nextLayer = 0;
+    arrayMode = false;
+
+    maxResident = 0;
+    numResident = 0;
+
+#ifdef GLEXTENSIONS_LOADED
+    if ( ! pixelBuffers.empty() )
+    {
+        GLExtensions().deleteBuffers( GLsizei( pixelBuffers.size() ), & pixelBuffers[0] );
+        pixelBuffers.clear();
+    }
+#endif
+}
+
+bool blockTextures::Upload( int blockIndex, const std::vector<unsigned char> & image )
+{
+    if ( ! Reserve( blockIndex ) )
+    {
+        return false;
+    }
+
+    const unsigned char * texels = & image[0];
+
+#ifdef GLEXTENSIONS_LOADED
+    const glExtensions & gl = GLExtensions();
+
+    if ( ! pixelBuffers.empty() )
+    {
+        // respecifying the buffer's data hands its old storage back to the driver,
+        // so a copy still reading it does not hold this upload up
+        gl.bindBuffer( GL_PIXEL_UNPACK_BUFFER, pixelBuffers[ nextPixelBuffer ] );
+        gl.bufferData( GL_PIXEL_UNPACK_BUFFER, GLsizeiptr( image.size() ), texels, GL_STREAM_DRAW );
+        nextPixelBuffer = ( nextPixelBuffer + 1 ) % pixelBuffers.size();
+
+        // texels are now read from the start of the bound buffer
+        texels = 0;
+    }
+
+    if ( arrayMode )
+    {
+        glBindTexture( GL_TEXTURE_2D_ARRAY, pages[ Page( blockIndex ) ] );
+        gl.texSubImage3D( GL_TEXTURE_2D_ARRAY, 0, 0, 0, Layer( blockIndex ), width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texels );
+    }
+    else
+#endif
+    {
+        glBindTexture( GL_TEXTURE_2D, textures[ blockIndex - minBlock ] );
+        glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, texels );
+    }
+
+#ifdef GLEXTENSIONS_LOADED
+    if ( ! pixelBuffers.empty() )
+    {
+        gl.bindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    }
+#endif
+
+    return true;
+}
+
+void blockTextures::Release( int blockIndex )
+{
+    if ( ! IsResident( blockIndex ) )
+    {
+        return;
+    }
+
+    if ( arrayMode )
+    {
+        spareLayers.push_back( blockLayer[ blockIndex - minBlock ] );
+        blockLayer[ blockIndex - minBlock ] = -1;
+    }
+    else
+    {
+        spareTextures.push_back( textures[ blockIndex - minBlock ] );
+        textures[ blockIndex - minBlock ] = 0;
+    }
+
+    numResident--;
+}
+
+bool blockTextures::IsResident( int blockIndex ) const
+{
+    const unsigned int index = blockIndex - minBlock;
+
+    if ( arrayMode )
+    {
+        return index < blockLayer.size() && blockLayer[ index ] >= 0;
+    }
+
+    return index < textures.size() && textures[ index ] != 0;
+}
+
+int blockTextures::NumResident() const
+{
+    return numResident;
+}
+
+int blockTextures::MaxResident() const
+{
+    return maxResident;
+}
+
+void blockTextures::setMaxResident( int theMaxResident )
+{
+    const int numBlocks = int( arrayMode ? blockLayer.size() : textures.size() );
+
+    maxResident = std::max( 0, std::min( theMaxResident, numBlocks ) );
+}
+
+bool blockTextures::IsArray() const
+{
+    return arrayMode;
+}
+
+int blockTextures::NumPages() const
+{
+    return int( pages.size() );
+}
+
+GLuint blockTextures::PageTexture( int page ) const
+{
+    return pages[ page ];
+}
+
+int blockTextures::Page( int blockIndex ) const
+{
+    return blockLayer[ blockIndex - minBlock ] / s_page_layers;
+}
+
+int blockTextures::Layer( int blockIndex ) const
+{
+    return blockLayer[ blockIndex - minBlock ] % s_page_layers;
+}
+
+void blockTextures::Bind( int blockIndex ) const
+{
+    glBindTexture( GL_TEXTURE_2D, textures[ blockIndex - minBlock ] );
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+}
+
+bool blockTextures::Reserve( int blockIndex )
+{
+    if ( IsResident( blockIndex ) )
+    {
+        return true;
+    }
+
+    if ( numResident >= maxResident )
+    {
+        return false;
+    }
+
+    if ( arrayMode )
+    {
+        int layer = -1;
+
+        if ( ! spareLayers.empty() )
+        {
+            layer = spareLayers.back();
+            spareLayers.pop_back();
+        }
+        else if ( ( ! pages.empty() && nextLayer < int( pages.size() - 1 ) * s_page_layers + pageLayers.back() ) || NewPage() )
+        {
+            layer = nextLayer++;
+        }
+        else
+        {
+            printf( "Out of texture memory, keeping %d blocks\n", numResident );
+            maxResident = numResident;
+            return false;
+        }
+
+        blockLayer[ blockIndex - minBlock ] = layer;
+    }
+    else
+    {
+        GLuint texture = 0;
+
+        if ( ! spareTextures.empty() )
+        {
+            texture = spareTextures.back();
+            spareTextures.pop_back();
+        }
+        else
+        {
+            texture = NewTexture();
+        }
+
+        if ( ! texture )
+        {
+            // keep what fits and stop asking for more
+            printf( "Out of texture memory, keeping %d blocks\n", numResident );
+            maxResident = numResident;
+            return false;
+        }
+
+        textures[ blockIndex - minBlock ] = texture;
+    }
+
+    numResident++;
+
+    return true;
+}
+
+GLuint blockTextures::NewTexture()
+{
+    // clear errors left by earlier calls
+    OutOfMemory();
+
+    GLuint texture = 0;
+    glGenTextures( 1, & texture );
+    glBindTexture( GL_TEXTURE_2D, texture );
+
+#ifdef GLEXTENSIONS_LOADED
+    const glExtensions & gl = GLExtensions();
+
+    if ( gl.texStorage2D )
+    {
+        gl.texStorage2D( GL_TEXTURE_2D, 1, GL_RGBA8, width, height );
+    }
+    else
+#endif
+    {
+        glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+    }
+
+    if ( OutOfMemory() )
+    {
+        glDeleteTextures( 1, & texture );
+        return 0;
+    }
+
+    SetParameters( GL_TEXTURE_2D );
+
+    return texture;
+}
+
+bool blockTextures::NewPage()
+{
+#ifdef GLEXTENSIONS_LOADED
+    const glExtensions & gl = GLExtensions();
+
+    int allocated = 0;
+    for ( unsigned int i = 0 ; i < pageLayers.size() ; i++ )
+    {
+        allocated += pageLayers[i];
+    }
+
+    // the last page stops at the budget
+    const int layers = std::min( s_page_layers, maxResident - allocated );
+
+    if ( layers <= 0 )
+    {
+        return false;
+    }
+
+    // clear errors left by earlier calls
+    OutOfMemory();
+
+    GLuint page = 0;
+    glGenTextures( 1, & page );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, page );
+
+    if ( gl.texStorage3D )
+    {
+        gl.texStorage3D( GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, width, height, layers );
+    }
+    else
+    {
+        gl.texImage3D( GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+    }
+
+    if ( OutOfMemory() )
+    {
+        glDeleteTextures( 1, & page );
+        return false;
+    }
+
+    SetParameters( GL_TEXTURE_2D_ARRAY );
+
+    nextLayer = int( pages.size() ) * s_page_layers;
+    pages.push_back( page );
+    pageLayers.push_back( layers );
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void blockTextures::SetParameters( GLenum target )
+{
+    glTexParameteri( target, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+    glTexParameteri( target, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+
+    glTexParameteri( target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+    glTexParameteri( target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+}
+
+bool blockTextures::OutOfMemory()
+{
+    bool outOfMemory = false;
+
+    // errors queue up, read them all so none is left for the next check
+    for ( GLenum error = glGetError() ; error != GL_NO_ERROR ; error = glGetError() )
+    {
+        outOfMemory = outOfMemory || error == GL_OUT_OF_MEMORY;
+    }
+
+    return outOfMemory;
+}
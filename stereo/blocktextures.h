@@ -0,0 +1,113 @@
+#ifndef BLOCKTEXTURES_H_INCLUDED
+#define BLOCKTEXTURES_H_INCLUDED
+
+#include <vector>
+
+#include "glutaux.h"
+
+// blockTextures
+// + keeps the textures of a range of blocks, all the same size
+// + storage is allocated when a block is first uploaded, and at most maxResident blocks hold storage at once
+// + released blocks hand their storage on to the next block uploaded, nothing is allocated again once the budget is used
+// + blocks are either layers of array textures, for drawing with blockRenderer, or textures of their own
+// + array textures are pages of a few layers allocated as blocks need them, a released layer takes the next block
+// + texture parameters are set when the storage is allocated, uploads only replace the texels
+// + uploads are staged in a ring of pixel buffer objects, so the driver copies them to the texture
+//   without making the render thread wait, and a buffer is not reused while its copy may be pending
+// + falls back to mutable storage and plain uploads where the OpenGL implementation lacks
+//   immutable textures or pixel buffer objects
+class blockTextures
+{
+public:
+
+    blockTextures();
+
+    // prepares textures of width x height RGBA texels for blocks minBlock to maxBlock, at most maxResident of them at once
+    // blocks are layers of an array texture if asArray is set and the context has array textures
+    // needs a current OpenGL context
+    void Alloc( int minBlock, int maxBlock, int width, int height, int maxResident, bool asArray );
+
+    // releases the textures and staging buffers
+    void Destroy();
+
+    // replaces the texels of a block with a RGBA image of the allocated size, giving the block storage if it has none
+    // returns false if maxResident blocks already have storage or OpenGL is out of texture memory
+    bool Upload( int blockIndex, const std::vector<unsigned char> & image );
+
+    // hands the storage of a block on to the next block uploaded
+    void Release( int blockIndex );
+
+    // returns true if a block has storage
+    bool IsResident( int blockIndex ) const;
+
+    // number of blocks with storage and the most allowed
+    int NumResident() const;
+    int MaxResident() const;
+
+    // changes the most blocks with storage, blocks above a lower limit must be released by the caller
+    void setMaxResident( int theMaxResident );
+
+    // returns true if blocks are layers of array textures
+    bool IsArray() const;
+
+    // number of array textures allocated and the array texture of a page
+    int NumPages() const;
+    GLuint PageTexture( int page ) const;
+
+    // returns the page and the layer in that page of a block with storage
+    int Page( int blockIndex ) const;
+    int Layer( int blockIndex ) const;
+
+    // binds the texture of a block to GL_TEXTURE_2D, only for blocks with textures of their own
+    void Bind( int blockIndex ) const;
+
+protected:
+
+    // gives a block storage, returns false if there is no room
+    bool Reserve( int blockIndex );
+
+    // returns a new texture with storage for a block, 0 if OpenGL is out of texture memory
+    GLuint NewTexture();
+
+    // allocates an array texture of up to s_page_layers layers, returns false if OpenGL is out of texture memory
+    bool NewPage();
+
+    // sets filtering and wrapping of the texture bound to target
+    static void SetParameters( GLenum target );
+
+    // returns true if the last allocation ran out of memory, clearing the error state
+    static bool OutOfMemory();
+
+    int minBlock;
+    int width;
+    int height;
+
+    int maxResident;
+    int numResident;
+
+    // texture names of blocks minBlock on, 0 for blocks without storage, empty if blocks are layers of pages
+    std::vector<GLuint> textures;
+
+    // released textures keeping their storage for the next block
+    std::vector<GLuint> spareTextures;
+
+    // blocks are layers of array textures
+    bool arrayMode;
+
+    // array textures and the layers each holds
+    std::vector<GLuint> pages;
+    std::vector<int> pageLayers;
+
+    // layer of each block from minBlock on, page times the most layers of a page plus the layer in the page, -1 without storage
+    std::vector<int> blockLayer;
+
+    // released layers for the next block, and the next layer of the last page never used
+    std::vector<int> spareLayers;
+    int nextLayer;
+
+    // staging buffers used in turn, empty without pixel buffer objects
+    std::vector<GLuint> pixelBuffers;
+    unsigned int nextPixelBuffer;
+};
+
+#endif // BLOCKTEXTURES_H_INCLUDED
@@ -0,0 +1,306 @@
+#include "colorize.h"
+
+// the vector kernels need target attributes on intrinsics and __builtin_cpu_supports( "avx2" ),
+// older compilers such as gcc 4.4 on RHEL6 get the scalar path only
+// clang reports itself as gcc 4.2 whatever its version, so it is asked for the features instead
+#if defined( __x86_64__ ) || defined( __i386__ )
+# if defined( __clang__ )
+#  if __has_attribute( target ) && __has_builtin( __builtin_cpu_supports )
+#   define COLORIZE_X86
+#  endif
+# elif defined( __GNUC__ ) && ( __GNUC__ > 4 || ( __GNUC__ == 4 && __GNUC_MINOR__ >= 9 ) )
+#  define COLORIZE_X86
+# endif
+#endif
+
+#ifdef COLORIZE_X86
+# include <immintrin.h>
+#endif
+
+// colorizes numEyes rows of one or two eyes
+typedef void ( * colorizeFunction )( const colorizeRows * eyes, int numEyes, int width );
+
+// a kernel and its name
+struct colorizeKernel
+{
+    colorizeFunction function;
+    const char * name;
+};
+
+static inline unsigned char ColorizeValue( unsigned short value, float scale )
+{
+    float color = ( value >> 2 ) * scale;
+
+    if ( color < 0.0f ) color = 0.0f;
+    if ( color > 255.0f ) color = 255.0f;
+
+    return ( unsigned char ) color;
+}
+
+static inline bool IsTransparent( const colorizeRows & eye, int x )
+{
+    return ( eye.rows[0][x] == eye.fillValue[0] ) || ( eye.rows[1][x] == eye.fillValue[1] ) || ( eye.rows[2][x] == eye.fillValue[2] );
+}
+
+// colorizes pixels first..width-1 one at a time
+static void ColorizeScalar( const colorizeRows * eyes, int numEyes, int first, int width )
+{
+    for ( int x = first ; x < width ; x++ )
+    {
+        bool isTransparent[2] = { false, false };
+        bool blackout = false;
+
+        for ( int e = 0 ; e < numEyes ; e++ )
+        {
+            isTransparent[e] = IsTransparent( eyes[e], x );
+        }
+
+        if ( numEyes == 2 )
+        {
+            blackout = isTransparent[0] || isTransparent[1];
+        }
+
+        for ( int e = 0 ; e < numEyes ; e++ )
+        {
+            unsigned char * pixel = eyes[e].pixel + 4 * x;
+
+            for ( int i = 0 ; i < 3 ; i++ )
+            {
+                pixel[i] = blackout ? 0 : ColorizeValue( eyes[e].rows[i][x], eyes[e].scale[i] );
+            }
+
+            pixel[3] = isTransparent[e] ? 0 : 255;
+        }
+    }
+}
+
+static void ColorizeGeneric( const colorizeRows * eyes, int numEyes, int width )
+{
+    ColorizeScalar( eyes, numEyes, 0, width );
+}
+
+#ifdef COLORIZE_X86
+
+// scales 8 values of a channel, returns them as 16 bit integers
+__attribute__(( target( "sse2" ) ))
+static inline __m128i ColorizeChannelSSE2( __m128i values, __m128 scale )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 black = _mm_setzero_ps();
+    const __m128 white = _mm_set1_ps( 255.0f );
+
+    values = _mm_srli_epi16( values, 2 );
+
+    __m128 low = _mm_cvtepi32_ps( _mm_unpacklo_epi16( values, zero ) );
+    __m128 high = _mm_cvtepi32_ps( _mm_unpackhi_epi16( values, zero ) );
+
+    low = _mm_min_ps( _mm_max_ps( _mm_mul_ps( low, scale ), black ), white );
+    high = _mm_min_ps( _mm_max_ps( _mm_mul_ps( high, scale ), black ), white );
+
+    return _mm_packs_epi32( _mm_cvttps_epi32( low ), _mm_cvttps_epi32( high ) );
+}
+
+// writes 8 RGBA pixels, colors are cleared where blackout is set
+__attribute__(( target( "sse2" ) ))
+static inline void StorePixelsSSE2( const __m128i values[3], const __m128 scale[3], __m128i transparent, __m128i blackout, unsigned char * pixel )
+{
+    const __m128i opaque = _mm_set1_epi16( 255 );
+
+    __m128i red = _mm_andnot_si128( blackout, ColorizeChannelSSE2( values[0], scale[0] ) );
+    __m128i green = _mm_andnot_si128( blackout, ColorizeChannelSSE2( values[1], scale[1] ) );
+    __m128i blue = _mm_andnot_si128( blackout, ColorizeChannelSSE2( values[2], scale[2] ) );
+    __m128i alpha = _mm_andnot_si128( transparent, opaque );
+
+    // interleave to RGBA bytes
+    __m128i redGreen = _mm_or_si128( red, _mm_slli_epi16( green, 8 ) );
+    __m128i blueAlpha = _mm_or_si128( blue, _mm_slli_epi16( alpha, 8 ) );
+
+    _mm_storeu_si128( ( __m128i * )( pixel ), _mm_unpacklo_epi16( redGreen, blueAlpha ) );
+    _mm_storeu_si128( ( __m128i * )( pixel + 16 ), _mm_unpackhi_epi16( redGreen, blueAlpha ) );
+}
+
+__attribute__(( target( "sse2" ) ))
+static void ColorizeSSE2( const colorizeRows * eyes, int numEyes, int width )
+{
+    __m128 scale[2][3];
+    __m128i fill[2][3];
+
+    for ( int e = 0 ; e < numEyes ; e++ )
+    {
+        for ( int i = 0 ; i < 3 ; i++ )
+        {
+            scale[e][i] = _mm_set1_ps( eyes[e].scale[i] );
+            fill[e][i] = _mm_set1_epi16( short( eyes[e].fillValue[i] ) );
+        }
+    }
+
+    int x = 0;
+
+    for ( ; x + 8 <= width ; x += 8 )
+    {
+        __m128i values[2][3];
+        __m128i transparent[2];
+        __m128i blackout = _mm_setzero_si128();
+
+        for ( int e = 0 ; e < numEyes ; e++ )
+        {
+            transparent[e] = _mm_setzero_si128();
+
+            for ( int i = 0 ; i < 3 ; i++ )
+            {
+                values[e][i] = _mm_loadu_si128( ( const __m128i * )( eyes[e].rows[i] + x ) );
+                transparent[e] = _mm_or_si128( transparent[e], _mm_cmpeq_epi16( values[e][i], fill[e][i] ) );
+            }
+        }
+
+        if ( numEyes == 2 )
+        {
+            blackout = _mm_or_si128( transparent[0], transparent[1] );
+        }
+
+        for ( int e = 0 ; e < numEyes ; e++ )
+        {
+            StorePixelsSSE2( values[e], scale[e], transparent[e], blackout, eyes[e].pixel + 4 * x );
+        }
+    }
+
+    ColorizeScalar( eyes, numEyes, x, width );
+}
+
+// scales 16 values of a channel, returns them as 16 bit integers in order
+__attribute__(( target( "avx2" ) ))
+static inline __m256i ColorizeChannelAVX2( __m256i values, __m256 scale )
+{
+    const __m256 black = _mm256_setzero_ps();
+    const __m256 white = _mm256_set1_ps( 255.0f );
+
+    values = _mm256_srli_epi16( values, 2 );
+
+    __m256 low = _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm256_castsi256_si128( values ) ) );
+    __m256 high = _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm256_extracti128_si256( values, 1 ) ) );
+
+    low = _mm256_min_ps( _mm256_max_ps( _mm256_mul_ps( low, scale ), black ), white );
+    high = _mm256_min_ps( _mm256_max_ps( _mm256_mul_ps( high, scale ), black ), white );
+
+    // packing works per 128 bit lane, put the quarters back in order
+    __m256i packed = _mm256_packs_epi32( _mm256_cvttps_epi32( low ), _mm256_cvttps_epi32( high ) );
+    return _mm256_permute4x64_epi64( packed, 0xD8 );
+}
+
+// writes 16 RGBA pixels, colors are cleared where blackout is set
+__attribute__(( target( "avx2" ) ))
+static inline void StorePixelsAVX2( const __m256i values[3], const __m256 scale[3], __m256i transparent, __m256i blackout, unsigned char * pixel )
+{
+    const __m256i opaque = _mm256_set1_epi16( 255 );
+
+    __m256i red = _mm256_andnot_si256( blackout, ColorizeChannelAVX2( values[0], scale[0] ) );
+    __m256i green = _mm256_andnot_si256( blackout, ColorizeChannelAVX2( values[1], scale[1] ) );
+    __m256i blue = _mm256_andnot_si256( blackout, ColorizeChannelAVX2( values[2], scale[2] ) );
+    __m256i alpha = _mm256_andnot_si256( transparent, opaque );
+
+    // interleave to RGBA bytes, unpacking also works per 128 bit lane
+    __m256i redGreen = _mm256_or_si256( red, _mm256_slli_epi16( green, 8 ) );
+    __m256i blueAlpha = _mm256_or_si256( blue, _mm256_slli_epi16( alpha, 8 ) );
+
+    __m256i low = _mm256_unpacklo_epi16( redGreen, blueAlpha );
+    __m256i high = _mm256_unpackhi_epi16( redGreen, blueAlpha );
+
+    _mm256_storeu_si256( ( __m256i * )( pixel ), _mm256_permute2x128_si256( low, high, 0x20 ) );
+    _mm256_storeu_si256( ( __m256i * )( pixel + 32 ), _mm256_permute2x128_si256( low, high, 0x31 ) );
+}
+
+__attribute__(( target( "avx2" ) ))
+static void ColorizeAVX2( const colorizeRows * eyes, int numEyes, int width )
+{
+    __m256 scale[2][3];
+    __m256i fill[2][3];
+
+    for ( int e = 0 ; e < numEyes ; e++ )
+    {
+        for ( int i = 0 ; i < 3 ; i++ )
+        {
+            scale[e][i] = _mm256_set1_ps( eyes[e].scale[i] );
+            fill[e][i] = _mm256_set1_epi16( short( eyes[e].fillValue[i] ) );
+        }
+    }
+
+    int x = 0;
+
+    for ( ; x + 16 <= width ; x += 16 )
+    {
+        __m256i values[2][3];
+        __m256i transparent[2];
+        __m256i blackout = _mm256_setzero_si256();
+
+        for ( int e = 0 ; e < numEyes ; e++ )
+        {
+            transparent[e] = _mm256_setzero_si256();
+
+            for ( int i = 0 ; i < 3 ; i++ )
+            {
+                values[e][i] = _mm256_loadu_si256( ( const __m256i * )( eyes[e].rows[i] + x ) );
+                transparent[e] = _mm256_or_si256( transparent[e], _mm256_cmpeq_epi16( values[e][i], fill[e][i] ) );
+            }
+        }
+
+        if ( numEyes == 2 )
+        {
+            blackout = _mm256_or_si256( transparent[0], transparent[1] );
+        }
+
+        for ( int e = 0 ; e < numEyes ; e++ )
+        {
+            StorePixelsAVX2( values[e], scale[e], transparent[e], blackout, eyes[e].pixel + 4 * x );
+        }
+    }
+
+    ColorizeScalar( eyes, numEyes, x, width );
+}
+
+#endif // COLORIZE_X86
+
+static colorizeKernel SelectColorize()
+{
+#ifdef COLORIZE_X86
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        colorizeKernel kernel = { ColorizeAVX2, "avx2" };
+        return kernel;
+    }
+
+    if ( __builtin_cpu_supports( "sse2" ) )
+    {
+        colorizeKernel kernel = { ColorizeSSE2, "sse2" };
+        return kernel;
+    }
+#endif
+
+    colorizeKernel kernel = { ColorizeGeneric, "scalar" };
+    return kernel;
+}
+
+static const colorizeKernel & BestColorize()
+{
+    static const colorizeKernel best = SelectColorize();
+
+    return best;
+}
+
+void ColorizeRow( const colorizeRows & eye, int width )
+{
+    BestColorize().function( & eye, 1, width );
+}
+
+void ColorizePairRow( const colorizeRows & left, const colorizeRows & right, int width )
+{
+    colorizeRows eyes[2] = { left, right };
+
+    BestColorize().function( eyes, 2, width );
+}
+
+const char * ColorizeKernelName()
+{
+    return BestColorize().name;
+}
@@ -0,0 +1,26 @@
+#ifndef COLORIZE_H_INCLUDED
+#define COLORIZE_H_INCLUDED
+
+// one row of radiance samples of an eye and where its RGBA pixels go
+struct colorizeRows
+{
+    const unsigned short * rows[3];
+    float scale[3];
+    unsigned short fillValue[3];
+    unsigned char * pixel;
+};
+
+// writes width RGBA pixels from one row of each radiance channel
+// + each color is ( unsigned char ) clamp( ( value >> 2 ) * scale, 0.0f, 255.0f )
+// + alpha is 0 where any channel holds its fill value and 255 elsewhere
+// + uses AVX2 or SSE2 when the processor and compiler have them, with identical results
+void ColorizeRow( const colorizeRows & eye, int width );
+
+// the same as ColorizeRow for both eyes of a stereo pair in one pass
+// + colors are 0 in both eyes where either eye is transparent
+void ColorizePairRow( const colorizeRows & left, const colorizeRows & right, int width );
+
+// returns the name of the kernel in use, "avx2", "sse2" or "scalar"
+const char * ColorizeKernelName();
+
+#endif // COLORIZE_H_INCLUDED
@@ -0,0 +1,307 @@
+#include <stdlib.h>
+
+#include "datablockcache.h"
+
+// budget of the shared cache unless $MISR_DATA_CACHE_MB is set
+static const double s_data_cache_mb = 256.0;
+
+dataBlockCache::dataBlockCache( double maxBytes )
+:
+newest( 0 ),
+oldest( 0 ),
+pool(),
+bytes( 0.0 ),
+maxBytes( maxBytes ),
+hits( 0 ),
+misses( 0 ),
+evictions( 0 )
+{
+
+}
+
+dataBlockCache::~dataBlockCache()
+{
+    // the slots are not cleared, at exit the data sources holding them may be gone already
+    while ( oldest )
+    {
+        block * cached = oldest;
+        Unlink( cached );
+        Free( cached );
+    }
+
+    while ( ! pool.empty() )
+    {
+        Free( TakePooled( pool.begin()->first ) );
+    }
+}
+
+dataBlockCache & dataBlockCache::Default()
+{
+    static dataBlockCache cache( ( getenv( "MISR_DATA_CACHE_MB" ) ? atof( getenv( "MISR_DATA_CACHE_MB" ) ) : s_data_cache_mb ) * 1024.0 * 1024.0 );
+    return cache;
+}
+
+dataBlockCache::block * dataBlockCache::Find( block * & slot )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    block * cached = slot;
+
+    if ( ! cached )
+    {
+        ++misses;
+        return 0;
+    }
+
+    ++hits;
+    ++cached->pins;
+
+    Unlink( cached );
+    LinkNewest( cached );
+
+    return cached;
+}
+
+dataBlockCache::block * dataBlockCache::Insert( block * & slot, long blockBytes )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    if ( slot )
+    {
+        ++slot->pins;
+        return slot;
+    }
+
+    block * cached = Reclaim( blockBytes );
+
+    if ( ! cached )
+    {
+        cached = new block;
+        cached->data = new unsigned char [ blockBytes ];
+        cached->bytes = blockBytes;
+        bytes += double( blockBytes );
+    }
+
+    cached->slot = & slot;
+    cached->pins = 1;
+    slot = cached;
+
+    LinkNewest( cached );
+
+    return cached;
+}
+
+void dataBlockCache::Retain( block * cached )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    ++cached->pins;
+}
+
+void dataBlockCache::Release( block * cached )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    if ( --cached->pins == 0 && ! cached->slot )
+    {
+        // the last reader of an erased block is done with it
+        Pool( cached );
+    }
+
+    // pinned blocks can not be evicted, so inserts may have gone over the budget while they were read
+    if ( bytes > maxBytes )
+    {
+        Free( Reclaim( 0 ) );
+    }
+}
+
+void dataBlockCache::Erase( block * & slot )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    block * cached = slot;
+
+    if ( cached )
+    {
+        Unlink( cached );
+        slot = 0;
+        cached->slot = 0;
+
+        // a block still being read stays out of every list until Release pools it
+        if ( cached->pins == 0 )
+        {
+            Pool( cached );
+        }
+
+        Free( Reclaim( 0 ) );
+    }
+}
+
+void dataBlockCache::setMaxBytes( double theMaxBytes )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    maxBytes = theMaxBytes;
+    Free( Reclaim( 0 ) );
+}
+
+double dataBlockCache::MaxBytes() const
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    return maxBytes;
+}
+
+double dataBlockCache::Bytes() const
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    return bytes;
+}
+
+long long dataBlockCache::Hits() const
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    return hits;
+}
+
+long long dataBlockCache::Misses() const
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    return misses;
+}
+
+long long dataBlockCache::Evictions() const
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    return evictions;
+}
+
+void dataBlockCache::LinkNewest( block * cached )
+{
+    cached->newer = 0;
+    cached->older = newest;
+
+    if ( newest )
+    {
+        newest->newer = cached;
+    }
+    else
+    {
+        oldest = cached;
+    }
+
+    newest = cached;
+}
+
+void dataBlockCache::Unlink( block * cached )
+{
+    if ( cached->newer )
+    {
+        cached->newer->older = cached->older;
+    }
+    else
+    {
+        newest = cached->older;
+    }
+
+    if ( cached->older )
+    {
+        cached->older->newer = cached->newer;
+    }
+    else
+    {
+        oldest = cached->newer;
+    }
+
+    cached->newer = 0;
+    cached->older = 0;
+}
+
+dataBlockCache::block * dataBlockCache::TakePooled( long blockBytes )
+{
+    std::map<long, block *>::iterator found = pool.find( blockBytes );
+
+    if ( found == pool.end() )
+    {
+        return 0;
+    }
+
+    block * cached = found->second;
+
+    if ( cached->older )
+    {
+        found->second = cached->older;
+        cached->older = 0;
+    }
+    else
+    {
+        pool.erase( found );
+    }
+
+    return cached;
+}
+
+dataBlockCache::block * dataBlockCache::Reclaim( long blockBytes )
+{
+    // a pooled block of the same size costs nothing
+    block * cached = ( blockBytes > 0 ) ? TakePooled( blockBytes ) : 0;
+
+    if ( cached )
+    {
+        return cached;
+    }
+
+    // unused memory goes first
+    while ( bytes + double( blockBytes ) > maxBytes && ! pool.empty() )
+    {
+        Free( TakePooled( pool.begin()->first ) );
+    }
+
+    // then the least recently used blocks nobody is reading
+    block * candidate = oldest;
+
+    while ( bytes + double( blockBytes ) > maxBytes && candidate )
+    {
+        block * next = candidate->newer;
+
+        if ( candidate->pins == 0 )
+        {
+            Unlink( candidate );
+            *candidate->slot = 0;
+            ++evictions;
+
+            if ( candidate->bytes == blockBytes )
+            {
+                return candidate;
+            }
+
+            Free( candidate );
+        }
+
+        candidate = next;
+    }
+
+    return 0;
+}
+
+void dataBlockCache::Pool( block * cached )
+{
+    // keep the buffer for the next block of the same size
+    cached->newer = 0;
+    cached->older = pool[ cached->bytes ];
+    pool[ cached->bytes ] = cached;
+}
+
+void dataBlockCache::Free( block * cached )
+{
+    if ( cached )
+    {
+        bytes -= double( cached->bytes );
+        delete [] cached->data;
+        delete cached;
+    }
+}
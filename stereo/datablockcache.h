@@ -0,0 +1,102 @@
+#ifndef DATABLOCKCACHE_H_INCLUDED
+#define DATABLOCKCACHE_H_INCLUDED
+
+#include <map>
+#include <mutex>
+
+// dataBlockCache
+// + keeps the raw field blocks read by every hdfDataSource in the process within one byte budget
+// + blocks are linked into a recently used list through the blocks themselves, so a hit moves a block in constant time
+// + an evicted block keeps its buffer in a pool of blocks of the same size, to be reused by the next read of that size
+// + blocks in use are pinned and never evicted, an erased block in use is orphaned until its last pin is released
+// + safe to use from several threads at once
+class dataBlockCache
+{
+public:
+
+    // a cached block, owned by the cache and referenced by one slot of a data source
+    struct block
+    {
+        // recently used list, most recent at the head, or the pool list
+        block * newer;
+        block * older;
+
+        // the data source's pointer to this block, cleared when the block is evicted
+        // 0 for a pooled block, or an erased block that is still pinned
+        block ** slot;
+
+        unsigned char * data;
+        long bytes;
+        int pins;
+    };
+
+    dataBlockCache( double maxBytes );
+    ~dataBlockCache();
+
+    // returns the cache shared by all data sources, limited to $MISR_DATA_CACHE_MB megabytes
+    static dataBlockCache & Default();
+
+    // returns the block in slot pinned and moved to the head of the list, or 0 if slot is empty
+    block * Find( block * & slot );
+
+    // returns a pinned block of bytes bytes for slot, evicting least recently used blocks to stay in budget
+    // the caller fills in the data, no other thread may look in slot until it has
+    block * Insert( block * & slot, long bytes );
+
+    // pins a block already pinned by the caller once more
+    void Retain( block * cached );
+
+    // unpins a block returned by Find or Insert, pools an erased block with its last pin, and trims back to the budget
+    void Release( block * cached );
+
+    // clears slot and returns its block to the pool, or leaves it to the last Release if the block is pinned
+    void Erase( block * & slot );
+
+    void setMaxBytes( double theMaxBytes );
+    double MaxBytes() const;
+
+    // bytes of cached and pooled blocks
+    double Bytes() const;
+
+    long long Hits() const;
+    long long Misses() const;
+    long long Evictions() const;
+
+protected:
+
+    // links a block at the head of the recently used list
+    void LinkNewest( block * cached );
+
+    // unlinks a block from the recently used list
+    void Unlink( block * cached );
+
+    // removes a block of blockBytes bytes from the pool, returns 0 if there is none
+    block * TakePooled( long blockBytes );
+
+    // frees pooled blocks, then evicts least recently used blocks, until blockBytes more fit in the budget
+    // returns an evicted or pooled block of blockBytes bytes to be reused, or 0 if there is none
+    block * Reclaim( long blockBytes );
+
+    // puts a block that is in no list into the pool
+    void Pool( block * cached );
+
+    // deletes a block that is in no list
+    void Free( block * cached );
+
+    mutable std::mutex lock;
+
+    block * newest;
+    block * oldest;
+
+    // unused blocks by size, linked through older
+    std::map<long, block *> pool;
+
+    double bytes;
+    double maxBytes;
+
+    long long hits;
+    long long misses;
+    long long evictions;
+};
+
+#endif // DATABLOCKCACHE_H_INCLUDED
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "glextensions.h"
+
+#ifdef GLEXTENSIONS_LOADED
+
+#include <GL/glx.h>
+
+// returns true if the context is at least version major.minor or lists extension
+static bool HasFeature( int major, int minor, const char * extension )
+{
+    int contextMajor = 0, contextMinor = 0;
+    const char * version = ( const char * ) glGetString( GL_VERSION );
+    if ( version && sscanf( version, "%d.%d", & contextMajor, & contextMinor ) == 2 )
+    {
+        if ( contextMajor > major || ( contextMajor == major && contextMinor >= minor ) )
+        {
+            return true;
+        }
+    }
+
+    if ( ! extension )
+    {
+        return false;
+    }
+
+    // match whole names, GL_ARB_foo must not match GL_ARB_foo_bar
+    const char * extensions = ( const char * ) glGetString( GL_EXTENSIONS );
+    const size_t length = strlen( extension );
+    for ( const char * found = extensions ? strstr( extensions, extension ) : 0 ; found ; found = strstr( found + length, extension ) )
+    {
+        if ( ( found == extensions || found[-1] == ' ' ) && ( found[length] == ' ' || found[length] == '\0' ) )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// looks up an entry point under its core name, then under its extension name
+template<class procType>
+static void EntryPoint( procType & proc, const char * name, const char * suffix = "" )
+{
+    proc = ( procType ) glXGetProcAddressARB( ( const GLubyte * ) name );
+    if ( ! proc && suffix[0] )
+    {
+        proc = ( procType ) glXGetProcAddressARB( ( const GLubyte * ) ( std::string( name ) + suffix ).c_str() );
+    }
+}
+
+const glExtensions & GLExtensions()
+{
+    static glExtensions gl;
+    static bool checked = false;
+
+    if ( checked )
+    {
+        return gl;
+    }
+
+    checked = true;
+    memset( & gl, 0, sizeof( gl ) );
+
+    if ( HasFeature( 4, 2, "GL_ARB_texture_storage" ) )
+    {
+        EntryPoint( gl.texStorage2D, "glTexStorage2D" );
+        EntryPoint( gl.texStorage3D, "glTexStorage3D" );
+    }
+
+    if ( HasFeature( 1, 5, "GL_ARB_vertex_buffer_object" ) )
+    {
+        EntryPoint( gl.genBuffers, "glGenBuffers", "ARB" );
+        EntryPoint( gl.deleteBuffers, "glDeleteBuffers", "ARB" );
+        EntryPoint( gl.bindBuffer, "glBindBuffer", "ARB" );
+        EntryPoint( gl.bufferData, "glBufferData", "ARB" );
+        EntryPoint( gl.bufferSubData, "glBufferSubData", "ARB" );
+
+        if ( ! gl.genBuffers || ! gl.deleteBuffers || ! gl.bindBuffer || ! gl.bufferData || ! gl.bufferSubData )
+        {
+            gl.genBuffers = 0;
+        }
+    }
+
+    gl.pixelBuffers = gl.genBuffers && HasFeature( 2, 1, "GL_ARB_pixel_buffer_object" );
+
+    if ( gl.genBuffers && HasFeature( 3, 0, 0 ) )
+    {
+        EntryPoint( gl.texImage3D, "glTexImage3D" );
+        EntryPoint( gl.texSubImage3D, "glTexSubImage3D" );
+        EntryPoint( gl.multiDrawArrays, "glMultiDrawArrays" );
+
+        EntryPoint( gl.createShader, "glCreateShader" );
+        EntryPoint( gl.deleteShader, "glDeleteShader" );
+        EntryPoint( gl.shaderSource, "glShaderSource" );
+        EntryPoint( gl.compileShader, "glCompileShader" );
+        EntryPoint( gl.getShaderiv, "glGetShaderiv" );
+        EntryPoint( gl.getShaderInfoLog, "glGetShaderInfoLog" );
+
+        EntryPoint( gl.createProgram, "glCreateProgram" );
+        EntryPoint( gl.deleteProgram, "glDeleteProgram" );
+        EntryPoint( gl.attachShader, "glAttachShader" );
+        EntryPoint( gl.bindAttribLocation, "glBindAttribLocation" );
+        EntryPoint( gl.linkProgram, "glLinkProgram" );
+        EntryPoint( gl.getProgramiv, "glGetProgramiv" );
+        EntryPoint( gl.getProgramInfoLog, "glGetProgramInfoLog" );
+        EntryPoint( gl.useProgram, "glUseProgram" );
+        EntryPoint( gl.getUniformLocation, "glGetUniformLocation" );
+        EntryPoint( gl.uniform1i, "glUniform1i" );
+
+        EntryPoint( gl.vertexAttribPointer, "glVertexAttribPointer" );
+        EntryPoint( gl.enableVertexAttribArray, "glEnableVertexAttribArray" );
+        EntryPoint( gl.disableVertexAttribArray, "glDisableVertexAttribArray" );
+
+        gl.arrayTextures = gl.texImage3D && gl.texSubImage3D && gl.multiDrawArrays
+            && gl.createShader && gl.deleteShader && gl.shaderSource && gl.compileShader && gl.getShaderiv && gl.getShaderInfoLog
+            && gl.createProgram && gl.deleteProgram && gl.attachShader && gl.bindAttribLocation && gl.linkProgram
+            && gl.getProgramiv && gl.getProgramInfoLog && gl.useProgram && gl.getUniformLocation && gl.uniform1i
+            && gl.vertexAttribPointer && gl.enableVertexAttribArray && gl.disableVertexAttribArray;
+    }
+
+    return gl;
+}
+
+#endif // GLEXTENSIONS_LOADED
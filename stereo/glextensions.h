@@ -0,0 +1,69 @@
+#ifndef GLEXTENSIONS_H_INCLUDED
+#define GLEXTENSIONS_H_INCLUDED
+
+#include "glutaux.h"
+
+#if ! defined( __APPLE__ ) && ! defined( WIN32 )
+# include <GL/glext.h>
+# define GLEXTENSIONS_LOADED
+#endif
+
+#ifdef GLEXTENSIONS_LOADED
+
+// glExtensions
+// + entry points of OpenGL beyond version 1.1, looked up with glXGetProcAddressARB
+// + an entry point is 0 where the context does not have it, so callers can fall back on older paths
+// + other platforms have no loader, code using these is compiled only where GLEXTENSIONS_LOADED is defined
+struct glExtensions
+{
+    // immutable texture storage, OpenGL 4.2 or GL_ARB_texture_storage
+    PFNGLTEXSTORAGE2DPROC texStorage2D;
+    PFNGLTEXSTORAGE3DPROC texStorage3D;
+
+    // buffer objects, OpenGL 1.5 or GL_ARB_vertex_buffer_object
+    PFNGLGENBUFFERSPROC genBuffers;
+    PFNGLDELETEBUFFERSPROC deleteBuffers;
+    PFNGLBINDBUFFERPROC bindBuffer;
+    PFNGLBUFFERDATAPROC bufferData;
+    PFNGLBUFFERSUBDATAPROC bufferSubData;
+
+    // set if buffers can be bound to GL_PIXEL_UNPACK_BUFFER, OpenGL 2.1 or GL_ARB_pixel_buffer_object
+    bool pixelBuffers;
+
+    // array textures and GLSL 1.30 shaders, OpenGL 3.0
+    PFNGLTEXIMAGE3DPROC texImage3D;
+    PFNGLTEXSUBIMAGE3DPROC texSubImage3D;
+    PFNGLMULTIDRAWARRAYSPROC multiDrawArrays;
+
+    PFNGLCREATESHADERPROC createShader;
+    PFNGLDELETESHADERPROC deleteShader;
+    PFNGLSHADERSOURCEPROC shaderSource;
+    PFNGLCOMPILESHADERPROC compileShader;
+    PFNGLGETSHADERIVPROC getShaderiv;
+    PFNGLGETSHADERINFOLOGPROC getShaderInfoLog;
+
+    PFNGLCREATEPROGRAMPROC createProgram;
+    PFNGLDELETEPROGRAMPROC deleteProgram;
+    PFNGLATTACHSHADERPROC attachShader;
+    PFNGLBINDATTRIBLOCATIONPROC bindAttribLocation;
+    PFNGLLINKPROGRAMPROC linkProgram;
+    PFNGLGETPROGRAMIVPROC getProgramiv;
+    PFNGLGETPROGRAMINFOLOGPROC getProgramInfoLog;
+    PFNGLUSEPROGRAMPROC useProgram;
+    PFNGLGETUNIFORMLOCATIONPROC getUniformLocation;
+    PFNGLUNIFORM1IPROC uniform1i;
+
+    PFNGLVERTEXATTRIBPOINTERPROC vertexAttribPointer;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC enableVertexAttribArray;
+    PFNGLDISABLEVERTEXATTRIBARRAYPROC disableVertexAttribArray;
+
+    // set if all of the array texture and shader entry points above were found
+    bool arrayTextures;
+};
+
+// returns the entry points of the current context, looked up the first time it is called
+const glExtensions & GLExtensions();
+
+#endif // GLEXTENSIONS_LOADED
+
+#endif // GLEXTENSIONS_H_INCLUDED
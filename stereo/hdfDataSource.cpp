@@ -12,9 +12,8 @@ startBlock( dataField->StartBlock() ),
 endBlock( dataField->EndBlock() ),
 dimensionList( dims ),
 dataRect( 0, 0, hdfScalar( dataField->XDim() ), hdfScalar( dataField->YDim() ) ),
-blockLimit( 0x7FFFFFFF ),
-blockList( dataField->NumBlocks(), ( unsigned char * ) 0 ),
-validList()
+blockList( dataField->NumBlocks(), ( dataBlockCache::block * ) 0 ),
+blockLock()
 {
 	dataField->Open();
 }
@@ -24,7 +23,6 @@ validList()
 hdfDataSource::~hdfDataSource()
 {
 	BlockDestroyAll();
-	blockList.clear();
 }
 
 
@@ -36,20 +34,6 @@ hdfField hdfDataSource::DataField() const
 
 
 
-void hdfDataSource::setBlockLimit( int theBlockLimit )
-{
-	blockLimit = ( theBlockLimit > 1 ) ? ( theBlockLimit ) : ( 1 );
-}
-
-
-
-int hdfDataSource::BlockLimit() const
-{
-	return blockLimit;
-}
-
-
-
 void hdfDataSource::setBlockRange( int startBlockIndex, int endBlockIndex )
 {
 	setStartBlock( startBlockIndex );
@@ -102,40 +86,72 @@ const std::vector<int> & hdfDataSource::Dimensions() const
 
 hdfValue hdfDataSource::Value( const hdfCoord & location )
 {
-	hdfScalar metersPerBlock = fabs( dataField->BlockRect( dataField->StartBlock() ).Width() );
+	int blockIndex;
+	long offset;
 
-	int blockIndex = dataField->StartBlock() + int( ( location.x - dataField->BlockRect( dataField->StartBlock() ).Left() ) / metersPerBlock );
+	if ( ! Locate( location, blockIndex, offset ) )
+	{
+		return hdfValue( 0.0, 0.0 );
+	}
 
-	if ( blockIndex >= dataField->StartBlock() && blockIndex <= dataField->EndBlock() )
+	dataBlockCache::block * cached = AcquireBlock( blockIndex );
+
+	if ( ! cached )
 	{
-		if ( blockIndex >= StartBlock() && blockIndex <= EndBlock() )
-		{
-			if ( dataField->BlockRect( blockIndex ).Contains( location ) )
-			{
-				hdfCoord dataCoord(
-						dataRect.ConvertGlobal(
-							dataField->BlockRect( blockIndex ).ConvertLocal( location ) ) );
+		return hdfValue( 0.0, 0.0 );
+	}
 
-				int blockX = int( dataCoord.x );
-				int blockY = int( dataCoord.y );
+	hdfValue value( Sample( cached, offset ) );
 
-				if ( BlockValid( blockIndex ) == false )
-				{
-					BlockCreate( blockIndex );
-				}
+	ReleaseBlock( cached );
+
+	return value;
+}
 
-				unsigned char *dataPoint = blockList[ blockIndex ]
-					+ ( blockX * dataField->YDim() + blockY ) * dataField->DataSize();
 
-				if ( memcmp( dataPoint, dataField->FillValue(), dataField->DataSize() ) != 0 )
-				{
-					return hdfValue( ConvertToCommon( dataPoint ), 1 );
-				}
+
+std::vector<hdfValue> hdfDataSource::Values( const std::vector<hdfCoord> & location )
+{
+	std::vector<hdfValue> output( location.size(), hdfValue( 0.0, 0.0 ) );
+
+	// samples come in runs along the image, so the block of the last sample is kept pinned
+	dataBlockCache::block * cached = 0;
+	int cachedIndex = -1;
+
+	for ( unsigned int i = 0 ; i < location.size() ; i++ )
+	{
+		int blockIndex;
+		long offset;
+
+		if ( ! Locate( location[i], blockIndex, offset ) )
+		{
+			continue;
+		}
+
+		if ( blockIndex != cachedIndex )
+		{
+			if ( cached )
+			{
+				ReleaseBlock( cached );
 			}
+
+			// a block that can not be read is not tried again for the rest of the run
+			cached = AcquireBlock( blockIndex );
+			cachedIndex = blockIndex;
+		}
+
+		if ( cached )
+		{
+			output[i] = Sample( cached, offset );
 		}
 	}
 
-	return hdfValue( 0.0, 0.0 );
+	if ( cached )
+	{
+		ReleaseBlock( cached );
+	}
+
+	return output;
 }
 
 
@@ -149,38 +165,47 @@ std::list<hdfPolygon> hdfDataSource::GetMask() const
 
 matrix<hdfValue> hdfDataSource::GetBlock( int blockIndex )
 {
+	matrix<hdfValue> result;
+
 	if ( ( blockIndex >= StartBlock() ) && ( blockIndex <= EndBlock() ) )
 	{
-		matrix<hdfValue> result( DataField()->YDim(), DataField()->XDim() );
-		matrix<hdfValue>::iterator outData = result.begin();
+		switch ( dataField->DataType() )
+		{
+			case hdfChar8:    ConvertBlock<char8>(   blockIndex, result );   break;
+			case hdfUChar8:   ConvertBlock<uchar8>(  blockIndex, result );   break;
+			case hdfInt8:     ConvertBlock<int8>(    blockIndex, result );   break;
+			case hdfUInt8:    ConvertBlock<uint8>(   blockIndex, result );   break;
+			case hdfInt16:    ConvertBlock<int16>(   blockIndex, result );   break;
+			case hdfUInt16:   ConvertBlock<uint16>(  blockIndex, result );   break;
+			case hdfInt32:    ConvertBlock<int32>(   blockIndex, result );   break;
+			case hdfUInt32:   ConvertBlock<uint32>(  blockIndex, result );   break;
+			case hdfFloat32:  ConvertBlock<float32>( blockIndex, result );   break;
+			case hdfFloat64:  ConvertBlock<float64>( blockIndex, result );   break;
+			default: break;
+		}
+	}
 
-		BlockCreate( blockIndex );
-		unsigned char * rawData = blockList[ blockIndex ];
-		const int rawDataSize = DataField()->DataSize();
-		const void * rawFill = DataField()->FillValue();
+	return result;
+}
 
-		while ( outData != result.end() )
-		{
-			// check for fill value
-			if ( memcmp( rawData, rawFill, rawDataSize ) == 0 )
-			{
-				*outData = hdfValue( 0, 0 );
-			}
-			else
-			{
-				*outData = hdfValue( ConvertToCommon( rawData ), 1 );
-			}
 
-			// move to next pixel
-			++outData;
-			rawData += rawDataSize;
-		}
 
-		return result;
+template<class dataType>
+void hdfDataSource::ConvertBlock( int blockIndex, matrix<hdfValue> & result )
+{
+	hdfBlockView<dataType> view = GetBlockView<dataType>( blockIndex );
+
+	if ( ! view.IsValid() )
+	{
+		return;
 	}
-	else
+
+	result = matrix<hdfValue>( view.Height(), view.Width() );
+	matrix<hdfValue>::iterator outData = result.begin();
+
+	for ( int index = 0 ; index < view.Size() ; index++, ++outData )
 	{
-		return matrix<hdfValue>();
+		*outData = view.IsFill( index ) ? hdfValue( 0, 0 ) : hdfValue( hdfScalar( view[ index ] ), 1 );
 	}
 }
 
@@ -193,55 +218,91 @@ void hdfDataSource::Flush()
 
 
 
-void hdfDataSource::BlockCreate( int blockIndex )
+dataBlockCache::block * hdfDataSource::AcquireBlock( int blockIndex )
 {
-	if ( ! BlockValid( blockIndex ) )
+	std::lock_guard<std::mutex> guard( blockLock );
+
+	dataBlockCache & cache = dataBlockCache::Default();
+	dataBlockCache::block * cached = cache.Find( blockList[ blockIndex ] );
+
+	if ( ! cached )
 	{
-		if ( int( validList.size() ) >= blockLimit )
+		cached = cache.Insert( blockList[ blockIndex ], DataField()->BlockMemSize() );
+
+		if ( ! DataField()->ReadBlock( cached->data, blockIndex, Dimensions() ) )
 		{
-			BlockDestroy( validList.front() );
-			validList.pop_front();
+			// the buffer may hold an evicted block's samples, it must not be found as this one
+			cache.Erase( blockList[ blockIndex ] );
+			cache.Release( cached );
+			return 0;
 		}
+	}
 
-		blockList[ blockIndex ] = new unsigned char [ DataField()->BlockMemSize() ];
+	return cached;
+}
 
-		DataField()->ReadBlock( blockList[ blockIndex ], blockIndex, Dimensions() );
 
-		validList.push_back( blockIndex );
-	}
+
+void hdfDataSource::ReleaseBlock( dataBlockCache::block * cached )
+{
+	dataBlockCache::Default().Release( cached );
 }
 
 
 
-void hdfDataSource::BlockDestroy( int blockIndex )
+bool hdfDataSource::Locate( const hdfCoord & location, int & blockIndex, long & offset ) const
 {
-	if ( BlockValid( blockIndex ) )
+	hdfScalar metersPerBlock = fabs( dataField->BlockRect( dataField->StartBlock() ).Width() );
+
+	blockIndex = dataField->StartBlock() + int( ( location.x - dataField->BlockRect( dataField->StartBlock() ).Left() ) / metersPerBlock );
+
+	if ( blockIndex >= dataField->StartBlock() && blockIndex <= dataField->EndBlock() )
 	{
-		delete [] blockList[ blockIndex ];
+		if ( blockIndex >= StartBlock() && blockIndex <= EndBlock() )
+		{
+			if ( dataField->BlockRect( blockIndex ).Contains( location ) )
+			{
+				hdfCoord dataCoord(
+						dataRect.ConvertGlobal(
+							dataField->BlockRect( blockIndex ).ConvertLocal( location ) ) );
 
-		blockList[ blockIndex ] = 0;
+				int blockX = int( dataCoord.x );
+				int blockY = int( dataCoord.y );
+
+				offset = long( blockX * dataField->YDim() + blockY ) * dataField->DataSize();
+
+				return true;
+			}
+		}
 	}
+
+	return false;
 }
 
 
 
-void hdfDataSource::BlockDestroyAll()
+hdfValue hdfDataSource::Sample( const dataBlockCache::block * cached, long offset ) const
 {
-	std::list<int>::iterator current = validList.begin();
+	unsigned char *dataPoint = cached->data + offset;
 
-	while ( current != validList.end() )
+	if ( memcmp( dataPoint, dataField->FillValue(), dataField->DataSize() ) != 0 )
 	{
-		BlockDestroy( *current++ );
+		return hdfValue( ConvertToCommon( dataPoint ), 1 );
 	}
 
-	validList.clear();
+	return hdfValue( 0.0, 0.0 );
 }
 
 
 
-bool hdfDataSource::BlockValid( int blockIndex ) const
+void hdfDataSource::BlockDestroyAll()
 {
-	return ( blockList[ blockIndex ] != 0 );
+	std::lock_guard<std::mutex> guard( blockLock );
+
+	for ( unsigned int blockIndex = 0 ; blockIndex < blockList.size() ; blockIndex++ )
+	{
+		dataBlockCache::Default().Erase( blockList[ blockIndex ] );
+	}
 }
 
 
@@ -295,14 +356,47 @@ hdfValue hdfRadianceSource::Value( const hdfCoord & location )
 
 
 
+std::vector<hdfValue> hdfRadianceSource::Values( const std::vector<hdfCoord> & location )
+{
+	std::vector<hdfValue> ans( hdfDataSource::Values( location ) );
+
+	for ( unsigned int i = 0 ; i < ans.size() ; i++ )
+	{
+		ans[i].x = floor( ans[i].x / 4.0 ) * scaleFactor;
+	}
+
+	return ans;
+}
+
+
+
 hdfBrfSource::hdfBrfSource( ptr<hdfRadianceSource> dataRad, ptr<hdfDataSource> dataSZA )
 :
-hdfOpBinary<hdfOpBinaryMul>()
+hdfOpBinary<hdfOpBinaryMul>(),
+radiance( dataRad ),
+solarZenith( dataSZA ),
+radianceScale( pi * square( dataRad->DataField()->SolarDistance() )
+		/ dataRad->DataField()->SolarIrradiance() ),
+secant( new hdfOpUnary<hdfOpUnarySecDeg>( dataSZA ) ),
+scaled( new hdfOpUnary<hdfOpUnaryMul>( dataRad, radianceScale ) )
 {        
-	setInput( 0, new hdfOpUnary<hdfOpUnarySecDeg>( dataSZA ) );
-	setInput( 1, new hdfOpUnary<hdfOpUnaryMul>( dataRad,
-			hdfOpUnaryMul( pi * square( dataRad->DataField()->SolarDistance() )
-				/ dataRad->DataField()->SolarIrradiance() ) ) );
+	setInput( 0, secant );
+	setInput( 1, scaled );
+}
+
+
+
+hdfBrfSource::hdfBrfSource( ptr<hdfDataNode> dataRad, ptr<hdfDataNode> dataSZA, hdfScalar scale )
+:
+hdfOpBinary<hdfOpBinaryMul>(),
+radiance( dataRad ),
+solarZenith( dataSZA ),
+radianceScale( scale ),
+secant( new hdfOpUnary<hdfOpUnarySecDeg>( dataSZA ) ),
+scaled( new hdfOpUnary<hdfOpUnaryMul>( dataRad, radianceScale ) )
+{
+	setInput( 0, secant );
+	setInput( 1, scaled );
 }
 
 
@@ -314,12 +408,94 @@ hdfBrfSource::~hdfBrfSource()
 
 
 
+hdfValue hdfBrfSource::Value( const hdfCoord & location )
+{
+	if ( ! IsFused() )
+	{
+		return hdfOpBinary<hdfOpBinaryMul>::Value( location );
+	}
+
+	hdfValue radianceValue;
+	hdfValue solarZenithValue;
+
+	SourceValue( location, radianceValue, solarZenithValue );
+
+	return Expression( & radianceValue, & solarZenithValue )[ 0 ];
+}
+
+
+
+std::vector<hdfValue> hdfBrfSource::Values( const std::vector<hdfCoord> & location )
+{
+	if ( ! IsFused() )
+	{
+		return hdfOpBinary<hdfOpBinaryMul>::Values( location );
+	}
+
+	std::vector<hdfValue> radianceValues;
+	std::vector<hdfValue> solarZenithValues;
+	std::vector<hdfValue> output( location.size() );
+
+	if ( location.empty() )
+	{
+		return output;
+	}
+
+	SourceValues( location, radianceValues, solarZenithValues );
+	hdfExprEvaluate( Expression( & radianceValues[ 0 ], & solarZenithValues[ 0 ] ), output );
+
+	return output;
+}
+
+
+
+hdfBrfSource::expression hdfBrfSource::Expression( const hdfValue * radianceValues, const hdfValue * solarZenithValues ) const
+{
+	return hdfExpr( hdfOpBinaryMul(),
+			hdfExpr( hdfOpUnarySecDeg(), hdfExprBuffer( solarZenithValues ) ),
+			hdfExpr( radianceScale, hdfExprBuffer( radianceValues ) ) );
+}
+
+
+
+void hdfBrfSource::SourceValue( const hdfCoord & location, hdfValue & radianceValue, hdfValue & solarZenithValue )
+{
+	radianceValue = radiance->Value( location );
+	solarZenithValue = solarZenith->Value( location );
+}
+
+
+
+void hdfBrfSource::SourceValues( const std::vector<hdfCoord> & location, std::vector<hdfValue> & radianceValues, std::vector<hdfValue> & solarZenithValues )
+{
+	radianceValues = radiance->Values( location );
+	solarZenithValues = solarZenith->Values( location );
+}
+
+
+
+bool hdfBrfSource::IsFused() const
+{
+	return Input( 0 ) == secant && Input( 1 ) == scaled
+		&& secant->Input( 0 ) == solarZenith && scaled->Input( 0 ) == radiance;
+}
+
+
+
 hdfBdasSource::hdfBdasSource( ptr<hdfBrfSource> red1, ptr<hdfBrfSource> blue1, ptr<hdfBrfSource> red2, ptr<hdfBrfSource> blue2 )
 :
 hdfOpBinary<hdfOpBinarySub>()
 {
-	setInput( 0, new hdfOpBinary<hdfOpBinarySub>( red1, blue1 ) );
-	setInput( 1, new hdfOpBinary<hdfOpBinarySub>( red2, blue2 ) );
+	brf[0] = red1;
+	brf[1] = blue1;
+	brf[2] = red2;
+	brf[3] = blue2;
+
+	difference[0] = new hdfOpBinary<hdfOpBinarySub>( red1, blue1 );
+	difference[1] = new hdfOpBinary<hdfOpBinarySub>( red2, blue2 );
+
+	setInput( 0, difference[0] );
+	setInput( 1, difference[1] );
 }
 
 
@@ -328,3 +504,92 @@ hdfBdasSource::~hdfBdasSource()
 {
 
 }
+
+
+
+hdfValue hdfBdasSource::Value( const hdfCoord & location )
+{
+	if ( ! IsFused() )
+	{
+		return hdfOpBinary<hdfOpBinarySub>::Value( location );
+	}
+
+	hdfValue radianceValue[4];
+	hdfValue solarZenithValue[4];
+	const hdfValue * radianceValues[4];
+	const hdfValue * solarZenithValues[4];
+
+	for ( int i = 0 ; i < 4 ; i++ )
+	{
+		brf[i]->SourceValue( location, radianceValue[i], solarZenithValue[i] );
+		radianceValues[i] = & radianceValue[i];
+		solarZenithValues[i] = & solarZenithValue[i];
+	}
+
+	return Expression( radianceValues, solarZenithValues )[ 0 ];
+}
+
+
+
+std::vector<hdfValue> hdfBdasSource::Values( const std::vector<hdfCoord> & location )
+{
+	if ( ! IsFused() )
+	{
+		return hdfOpBinary<hdfOpBinarySub>::Values( location );
+	}
+
+	std::vector<hdfValue> radianceValue[4];
+	std::vector<hdfValue> solarZenithValue[4];
+	const hdfValue * radianceValues[4];
+	const hdfValue * solarZenithValues[4];
+	std::vector<hdfValue> output( location.size() );
+
+	if ( location.empty() )
+	{
+		return output;
+	}
+
+	for ( int i = 0 ; i < 4 ; i++ )
+	{
+		brf[i]->SourceValues( location, radianceValue[i], solarZenithValue[i] );
+		radianceValues[i] = & radianceValue[i][0];
+		solarZenithValues[i] = & solarZenithValue[i][0];
+	}
+
+	hdfExprEvaluate( Expression( radianceValues, solarZenithValues ), output );
+
+	return output;
+}
+
+
+
+hdfBdasSource::expression hdfBdasSource::Expression( const hdfValue * const radianceValues[4], const hdfValue * const solarZenithValues[4] ) const
+{
+	return hdfExpr( hdfOpBinarySub(),
+			hdfExpr( hdfOpBinarySub(),
+				brf[0]->Expression( radianceValues[0], solarZenithValues[0] ),
+				brf[1]->Expression( radianceValues[1], solarZenithValues[1] ) ),
+			hdfExpr( hdfOpBinarySub(),
+				brf[2]->Expression( radianceValues[2], solarZenithValues[2] ),
+				brf[3]->Expression( radianceValues[3], solarZenithValues[3] ) ) );
+}
+
+
+
+bool hdfBdasSource::IsFused() const
+{
+	if ( Input( 0 ) != difference[0] || Input( 1 ) != difference[1] )
+	{
+		return false;
+	}
+
+	for ( int i = 0 ; i < 4 ; i++ )
+	{
+		if ( difference[ i / 2 ]->Input( i % 2 ) != ptr<hdfDataNode>( brf[i] ) || ! brf[i]->IsFused() )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
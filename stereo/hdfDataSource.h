@@ -1,17 +1,135 @@
 #ifndef HDFDATASOURCE_H_INCLUDED
 #define HDFDATASOURCE_H_INCLUDED
 
+#include <limits>
 #include <list>
+#include <mutex>
 #include <vector>
 
+#include <string.h>
+
+#include "datablockcache.h"
 #include "matrix.h"
 #include "hdfBase.h"
 #include "hdfDataNode.h"
 #include "hdfDataOp.h"
+#include "hdfExpr.h"
 #include "hdfField.h"
 
+// hdfBlockView
+// + a typed view of the raw samples of one cached block, without copying or converting them
+// + samples are stored column by column, sample ( x, y ) is at x * Height() + y
+// + the block stays in the cache while a view of it exists
+template<class dataType>
+class hdfBlockView
+{
+	friend class hdfDataSource;
+
+public:
+
+	hdfBlockView() : cached( 0 ), width( 0 ), height( 0 ), fillValue() {}
+
+	hdfBlockView( const hdfBlockView & other )
+	:
+	cached( other.cached ),
+	width( other.width ),
+	height( other.height ),
+	fillValue( other.fillValue )
+	{
+		if ( cached ) dataBlockCache::Default().Retain( cached );
+	}
+
+	~hdfBlockView()
+	{
+		if ( cached ) dataBlockCache::Default().Release( cached );
+	}
+
+	hdfBlockView & operator=( const hdfBlockView & other )
+	{
+		if ( other.cached ) dataBlockCache::Default().Retain( other.cached );
+		if ( cached ) dataBlockCache::Default().Release( cached );
+
+		cached = other.cached;
+		width = other.width;
+		height = other.height;
+		fillValue = other.fillValue;
+
+		return *this;
+	}
+
+	// returns false if the block could not be viewed as dataType
+	bool IsValid() const { return cached != 0; }
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	int Size() const { return width * height; }
+
+	const dataType * begin() const { return cached ? ( const dataType * ) cached->data : 0; }
+	const dataType * end() const { return begin() + Size(); }
+
+	const dataType & operator[]( int index ) const { return begin()[ index ]; }
+	const dataType & operator()( int x, int y ) const { return begin()[ x * height + y ]; }
+
+	dataType FillValue() const { return fillValue; }
+
+	// returns true if a sample holds the field's fill value
+	bool IsFill( int index ) const { return memcmp( begin() + index, & fillValue, sizeof( dataType ) ) == 0; }
+
+	// sets one bit per sample, in sample order, for the samples that are not fill values
+	void ValidMask( std::vector<bool> & mask ) const
+	{
+		mask.resize( Size() );
+		for ( int index = 0 ; index < Size() ; index++ )
+		{
+			mask[ index ] = ! IsFill( index );
+		}
+	}
+
+protected:
+
+	hdfBlockView( dataBlockCache::block * theBlock, int theWidth, int theHeight, const void * theFillValue )
+	:
+	cached( theBlock ),
+	width( theWidth ),
+	height( theHeight ),
+	fillValue()
+	{
+		memcpy( & fillValue, theFillValue, sizeof( dataType ) );
+	}
+
+	dataBlockCache::block * cached;
+	int width;
+	int height;
+	dataType fillValue;
+};
+
+
+
+// returns true if samples of a field of type type can be read as dataType
+template<class dataType>
+bool hdfIsDataType( hdfDataType type )
+{
+	switch ( type )
+	{
+		case hdfChar8:
+		case hdfUChar8:   return std::numeric_limits<dataType>::is_integer && sizeof( dataType ) == 1;
+		case hdfInt8:     return std::numeric_limits<dataType>::is_integer && std::numeric_limits<dataType>::is_signed && sizeof( dataType ) == 1;
+		case hdfUInt8:    return std::numeric_limits<dataType>::is_integer && ! std::numeric_limits<dataType>::is_signed && sizeof( dataType ) == 1;
+		case hdfInt16:    return std::numeric_limits<dataType>::is_integer && std::numeric_limits<dataType>::is_signed && sizeof( dataType ) == 2;
+		case hdfUInt16:   return std::numeric_limits<dataType>::is_integer && ! std::numeric_limits<dataType>::is_signed && sizeof( dataType ) == 2;
+		case hdfInt32:    return std::numeric_limits<dataType>::is_integer && std::numeric_limits<dataType>::is_signed && sizeof( dataType ) == 4;
+		case hdfUInt32:   return std::numeric_limits<dataType>::is_integer && ! std::numeric_limits<dataType>::is_signed && sizeof( dataType ) == 4;
+		case hdfFloat32:  return ! std::numeric_limits<dataType>::is_integer && sizeof( dataType ) == 4;
+		case hdfFloat64:  return ! std::numeric_limits<dataType>::is_integer && sizeof( dataType ) == 8;
+		default:          return false;
+	}
+}
+
+
+
 // hdfDataSource
 // + attaches to a field for on-demand reading of data blocks
+// + blocks are kept in dataBlockCache::Default(), within the memory budget shared by all sources
 class hdfDataSource : public hdfDataNode
 {
 
@@ -23,9 +141,6 @@ public:
 
 	hdfField DataField() const;
 
-	void setBlockLimit( int theBlockLimit );
-	int BlockLimit() const;
-
 	void setBlockRange( int startBlockIndex, int endBlockIndex );
 
 	void setStartBlock( int blockIndex );
@@ -39,33 +154,63 @@ public:
 
 	virtual hdfValue Value( const hdfCoord & location );
 
+	// samples many points, keeping a block pinned while consecutive points fall in it
+	virtual std::vector<hdfValue> Values( const std::vector<hdfCoord> & location );
+
 	virtual std::list<hdfPolygon> GetMask() const;
 
 	matrix<hdfValue> GetBlock( int index );	
 
+	// returns a view of the raw samples of a block
+	// the view is invalid if the block is out of range, can not be read, or dataType does not match the field's data type
+	template<class dataType>
+	hdfBlockView<dataType> GetBlockView( int blockIndex )
+	{
+		if ( blockIndex < StartBlock() || blockIndex > EndBlock() || ! hdfIsDataType<dataType>( dataField->DataType() ) )
+		{
+			return hdfBlockView<dataType>();
+		}
+
+		return hdfBlockView<dataType>( AcquireBlock( blockIndex ), dataField->XDim(), dataField->YDim(), dataField->FillValue() );
+	}
+
 	void Flush();
 
 protected:
 
-	void BlockCreate( int blockIndex );
+	// returns a block pinned in the cache, reading it if it is not cached
+	// returns 0 if the block can not be read
+	dataBlockCache::block * AcquireBlock( int blockIndex );
 
-	void BlockDestroy( int blockIndex );
+	// unpins a block returned by AcquireBlock
+	void ReleaseBlock( dataBlockCache::block * cached );
 
-	void BlockDestroyAll();
+	// finds the block and the byte offset in it of the sample at location, returns false if no loaded block holds it
+	bool Locate( const hdfCoord & location, int & blockIndex, long & offset ) const;
 
-	bool BlockValid( int blockIndex ) const;
+	// returns the sample at offset in a pinned block, with a coverage of 0 for the fill value
+	hdfValue Sample( const dataBlockCache::block * cached, long offset ) const;
+
+	void BlockDestroyAll();
 
 	hdfScalar ConvertToCommon( void * data ) const;
 
+	// converts the samples of a block to values, with the data type resolved once for the whole block
+	template<class dataType>
+	void ConvertBlock( int blockIndex, matrix<hdfValue> & result );
+
 	hdfField dataField;
 	int startBlock;
 	int endBlock;
 	std::vector<int> dimensionList;
 
 	hdfRect dataRect;	
-	int blockLimit;
-	std::vector<unsigned char *> blockList;
-	std::list<int> validList;
+
+	// slots of the cached blocks, sized once since the cache points into it
+	std::vector<dataBlockCache::block *> blockList;
+
+	// serializes reading blocks of this source, so threads do not read the same block twice
+	std::mutex blockLock;
 };
 
 
@@ -83,6 +228,8 @@ public:
 
 	virtual hdfValue Value( const hdfCoord & location );
 
+	virtual std::vector<hdfValue> Values( const std::vector<hdfCoord> & location );
+
 protected:
 
 	double scaleFactor;
@@ -90,24 +237,85 @@ protected:
 
 
 
+// hdfBrfSource
+// + sec( solar zenith ) * radiance * pi * d^2 / E0
+// + keeps the operator tree as its inputs, but evaluates it as one fused expression
+// + once the tree has been rewired through setInput, it is evaluated node by node instead
 class hdfBrfSource : public hdfOpBinary<hdfOpBinaryMul>
 {
 public:
 
+	typedef hdfExprBinary< hdfOpBinaryMul,
+		hdfExprUnary< hdfOpUnarySecDeg, hdfExprBuffer >,
+		hdfExprUnary< hdfOpUnaryMul, hdfExprBuffer > > expression;
+
 	hdfBrfSource( ptr<hdfRadianceSource> dataRad, ptr<hdfDataSource> dataSZA );
 
+	// from any radiance and solar zenith nodes, with the radiance scale pi * d^2 / E0 given
+	hdfBrfSource( ptr<hdfDataNode> dataRad, ptr<hdfDataNode> dataSZA, hdfScalar scale );
+
 	virtual ~hdfBrfSource();
+
+	virtual hdfValue Value( const hdfCoord & location );
+
+	virtual std::vector<hdfValue> Values( const std::vector<hdfCoord> & location );
+
+	// returns the product over values of the radiance and solar zenith sources
+	expression Expression( const hdfValue * radianceValues, const hdfValue * solarZenithValues ) const;
+
+	// samples the radiance and solar zenith sources at one point
+	void SourceValue( const hdfCoord & location, hdfValue & radianceValue, hdfValue & solarZenithValue );
+
+	// samples the radiance and solar zenith sources at many points
+	void SourceValues( const std::vector<hdfCoord> & location, std::vector<hdfValue> & radianceValues, std::vector<hdfValue> & solarZenithValues );
+
+	// returns true while the inputs are still the tree built by the constructor, so the fused expression computes them
+	bool IsFused() const;
+
+protected:
+
+	ptr<hdfDataNode> radiance;
+	ptr<hdfDataNode> solarZenith;
+	hdfOpUnaryMul radianceScale;
+
+	// the operator nodes the constructor set as inputs
+	ptr<hdfDataNode> secant;
+	ptr<hdfDataNode> scaled;
 };
 
 
 
+// hdfBdasSource
+// + ( red1 - blue1 ) - ( red2 - blue2 ) of four BRF products
+// + evaluated as one fused expression over the eight underlying sources, while its tree is unchanged
 class hdfBdasSource : public hdfOpBinary<hdfOpBinarySub>
 {
 public:
 
+	typedef hdfExprBinary< hdfOpBinarySub,
+		hdfExprBinary< hdfOpBinarySub, hdfBrfSource::expression, hdfBrfSource::expression >,
+		hdfExprBinary< hdfOpBinarySub, hdfBrfSource::expression, hdfBrfSource::expression > > expression;
+
 	hdfBdasSource( ptr<hdfBrfSource> red1, ptr<hdfBrfSource> blue1, ptr<hdfBrfSource> red2, ptr<hdfBrfSource> blue2 );
 
 	virtual ~hdfBdasSource();
+
+	virtual hdfValue Value( const hdfCoord & location );
+
+	virtual std::vector<hdfValue> Values( const std::vector<hdfCoord> & location );
+
+	// returns true while the inputs are still the tree built by the constructor and every BRF is fused
+	bool IsFused() const;
+
+protected:
+
+	// returns the product over the radiance and solar zenith values of each BRF, in the order red1, blue1, red2, blue2
+	expression Expression( const hdfValue * const radianceValues[4], const hdfValue * const solarZenithValues[4] ) const;
+
+	ptr<hdfBrfSource> brf[4];
+
+	// the differences the constructor set as inputs
+	ptr<hdfDataNode> difference[2];
 };
 
 
@@ -1,4 +1,5 @@
 
+#include "blockfilecache.h"
 #include "hdfField.h"
 #include "hdfFile.h"
 #include "hdfGrid.h"
@@ -168,6 +169,8 @@ void *hdfFieldNode::FillValue() const
 
 bool hdfFieldNode::Read( void * dest, int blockMin, int blockMax, int xMin, int xMax, int yMin, int yMax, const std::vector<int> & dims ) const
 {
+	std::lock_guard<std::mutex> guard( hdfLibraryMutex() );
+
 	int32 start[ 16 ];
 	int32  edge[ 16 ];
 
@@ -186,7 +189,7 @@ bool hdfFieldNode::Read( void * dest, int blockMin, int blockMax, int xMin, int
 		edge[ i + 3 ] = 1;
 	}
 
-	int32 status = GDreadfield( Grid()->ValidHandle(), (char*) Name().c_str(), start, NULL, edge, dest );
+	int32 status = GDreadfield( parentGrid->ValidHandle(), (char*) Name().c_str(), start, NULL, edge, dest );
 
 	if ( status == FAIL )
 	{
@@ -201,7 +204,54 @@ bool hdfFieldNode::Read( void * dest, int blockMin, int blockMax, int xMin, int
 
 bool hdfFieldNode::ReadBlocks( void * dest, int blockMin, int blockMax, const std::vector<int> & dims ) const
 {
-	return Read( dest, blockMin, blockMax, 0, XDim() - 1, 0, YDim() - 1, dims );
+	const blockFileCache & cache = blockFileCache::Default();
+
+	if ( ! cache.IsEnabled() )
+	{
+		return Read( dest, blockMin, blockMax, 0, XDim() - 1, 0, YDim() - 1, dims );
+	}
+
+	unsigned char * blockData = ( unsigned char * ) dest;
+	const int blockBytes = BlockMemSize();
+
+	std::vector<bool> cached( blockMax - blockMin + 1 );
+
+	for ( int block = blockMin ; block <= blockMax ; ++block )
+	{
+		cached[ block - blockMin ] = cache.Load( *this, block, dims, blockData + ( block - blockMin ) * blockBytes );
+	}
+
+	// read each run of blocks missing from the cache in one call
+	for ( int first = blockMin ; first <= blockMax ; )
+	{
+		if ( cached[ first - blockMin ] )
+		{
+			++first;
+			continue;
+		}
+
+		int last = first;
+		while ( last < blockMax && ! cached[ last + 1 - blockMin ] )
+		{
+			++last;
+		}
+
+		unsigned char * runData = blockData + ( first - blockMin ) * blockBytes;
+
+		if ( ! Read( runData, first, last, 0, XDim() - 1, 0, YDim() - 1, dims ) )
+		{
+			return false;
+		}
+
+		for ( int block = first ; block <= last ; ++block )
+		{
+			cache.Store( *this, block, dims, runData + ( block - first ) * blockBytes );
+		}
+
+		first = last + 1;
+	}
+
+	return true;
 }
 
 
@@ -238,7 +288,7 @@ bool hdfFieldNode::Load( std::string fieldName )
 	char dimensionNameList[ 2048 ];
 
 	// get field information
-	status = GDfieldinfo( Grid()->Handle(), (char*)Name().c_str(), & fieldRank, dimensionSizeList, & fieldType, dimensionNameList );
+	status = GDfieldinfo( parentGrid->Handle(), (char*)Name().c_str(), & fieldRank, dimensionSizeList, & fieldType, dimensionNameList );
 	if ( status == FAIL )
 	{
 		printf( "couldn't read dimensions from field: %s\n", Name().c_str() );
@@ -275,7 +325,7 @@ bool hdfFieldNode::Load( std::string fieldName )
 	}	
 
 	// get fill value
-	status = GDgetfillvalue( Grid()->Handle(), (char*) Name().c_str(), fillValue );
+	status = GDgetfillvalue( parentGrid->Handle(), (char*) Name().c_str(), fillValue );
 	if ( status == FAIL )
 	{
 		printf( "couldn't get fill value from field: %s\n", Name().c_str() );
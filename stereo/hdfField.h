@@ -83,41 +83,41 @@ public:
 
 	// ancestor access functions ( file )
 
-	ptr<hdfFileNode> File() const { return Grid()->File(); }
+	ptr<hdfFileNode> File() const { return parentGrid->File(); }
 
-	std::string FileName() const { return File()->Name(); }
+	std::string FileName() const { return parentGrid->FileName(); }
 
-	int StartBlock() const { return File()->StartBlock(); }
-	int EndBlock() const { return File()->EndBlock(); }
-	int NumBlocks() const { return File()->NumBlocks(); }
+	int StartBlock() const { return parentGrid->StartBlock(); }
+	int EndBlock() const { return parentGrid->EndBlock(); }
+	int NumBlocks() const { return parentGrid->NumBlocks(); }
 
-	const hdfRect & BlockRect( int blockIndex ) const { return File()->BlockRect( blockIndex ); }
+	const hdfRect & BlockRect( int blockIndex ) const { return parentGrid->BlockRect( blockIndex ); }
 
-	hdfPolygon BlockPolygon( int blockIndex ) const { return File()->BlockPolygon( blockIndex ); }
-	std::list<hdfPolygon> BlockPolygonList() const { return File()->BlockPolygonList(); }
+	hdfPolygon BlockPolygon( int blockIndex ) const { return parentGrid->BlockPolygon( blockIndex ); }
+	std::list<hdfPolygon> BlockPolygonList() const { return parentGrid->BlockPolygonList(); }
 
-	int PathNumber() const { return File()->PathNumber(); }
+	int PathNumber() const { return parentGrid->PathNumber(); }
 
-	int CameraNumber() const { return File()->CameraNumber(); }
-	std::string CameraName() const { return File()->CameraName(); }
+	int CameraNumber() const { return parentGrid->CameraNumber(); }
+	std::string CameraName() const { return parentGrid->CameraName(); }
 
-	int OrbitNumber() const { return File()->OrbitNumber(); }
+	int OrbitNumber() const { return parentGrid->OrbitNumber(); }
 
 	// ancestor access functions ( grid )
 
-	std::string GridName() const { return Grid()->Name(); }
+	std::string GridName() const { return parentGrid->Name(); }
 
-	int XDim() const { return Grid()->XDim(); }
-	int YDim() const { return Grid()->YDim(); }
-	int BlockDim() const { return Grid()->BlockDim(); }
+	int XDim() const { return parentGrid->XDim(); }
+	int YDim() const { return parentGrid->YDim(); }
+	int BlockDim() const { return parentGrid->BlockDim(); }
 
-	const hdfRect & BoundRect() const { return Grid()->BoundRect(); }
+	const hdfRect & BoundRect() const { return parentGrid->BoundRect(); }
 
-	const double *ProjectionParameters() const { return Grid()->ProjectionParameters(); }
+	const double *ProjectionParameters() const { return parentGrid->ProjectionParameters(); }
 
-	double Scale() const { return Grid()->Scale(); }
-	double SolarIrradiance() const { return Grid()->SolarIrradiance(); }
-	double SolarDistance() const { return Grid()->SolarDistance(); }
+	double Scale() const { return parentGrid->Scale(); }
+	double SolarIrradiance() const { return parentGrid->SolarIrradiance(); }
+	double SolarDistance() const { return parentGrid->SolarDistance(); }
 
 protected:
 
@@ -1,9 +1,105 @@
 
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
 #include "hdfFile.h"
 #include "hdfGrid.h"
 #include "hdfField.h"
 #include "utility.h"
 
+// decoded PerBlockMetadataCommon record
+struct hdfBlockRecord
+{
+	int32 blockIndex;
+	uint8 oceanFlag;
+	float64 left;
+	float64 top;
+	float64 right;
+	float64 bottom;
+	uint8 dataFlag;
+};
+
+// fields of a PerBlockMetadataCommon record, in the order they are packed by VSread
+static const struct
+{
+	size_t offset;
+	size_t size;
+}
+hdfBlockRecordLayout[] =
+{
+	{ offsetof( hdfBlockRecord, blockIndex ), sizeof( int32 ) },
+	{ offsetof( hdfBlockRecord, oceanFlag ), sizeof( uint8 ) },
+	{ offsetof( hdfBlockRecord, left ), sizeof( float64 ) },
+	{ offsetof( hdfBlockRecord, top ), sizeof( float64 ) },
+	{ offsetof( hdfBlockRecord, right ), sizeof( float64 ) },
+	{ offsetof( hdfBlockRecord, bottom ), sizeof( float64 ) },
+	{ offsetof( hdfBlockRecord, dataFlag ), sizeof( uint8 ) }
+};
+
+
+
+// decodes packed PerBlockMetadataCommon records into a block list indexed by block number
+static bool DecodeBlockRecords( const uint8 * records, int numRecords, int recordSize, std::vector< hdfBlockData > & blocks )
+{
+	const int numFields = sizeof( hdfBlockRecordLayout ) / sizeof( hdfBlockRecordLayout[ 0 ] );
+
+	int packedSize = 0;
+	for ( int field = 0 ; field < numFields ; ++field )
+	{
+		packedSize += int( hdfBlockRecordLayout[ field ].size );
+	}
+
+	if ( recordSize < packedSize )
+	{
+		return false;
+	}
+
+	for ( int index = 0 ; index < numRecords ; ++index )
+	{
+		const uint8 * readData = records + index * recordSize;
+		hdfBlockRecord record;
+
+		for ( int field = 0 ; field < numFields ; ++field )
+		{
+			memcpy( ( uint8 * ) &record + hdfBlockRecordLayout[ field ].offset, readData, hdfBlockRecordLayout[ field ].size );
+			readData += hdfBlockRecordLayout[ field ].size;
+		}
+
+		if ( record.blockIndex < 0 )
+		{
+			return false;
+		}
+
+		// make room for new blocks
+		if ( int( blocks.size() ) <= record.blockIndex )
+		{
+			blocks.resize( record.blockIndex + 1 );
+		}
+
+		hdfBlockData & block = blocks[ record.blockIndex ];
+		block.oceanFlag = record.oceanFlag;
+		block.bounds.setLeft( record.left );
+		block.bounds.setTop( record.top );
+		block.bounds.setRight( record.right );
+		block.bounds.setBottom( record.bottom );
+		block.dataFlag = record.dataFlag;
+	}
+
+	return true;
+}
+
+
+
+std::mutex & hdfLibraryMutex()
+{
+	static std::mutex libraryMutex;
+	return libraryMutex;
+}
+
+
+
 // node functions //////////////////////////////////////////////////////////////
 
 
@@ -256,13 +352,30 @@ ptr<hdfFieldNode> hdfFileNode::Field( int fieldIndex ) const
 
 
 
+std::string hdfFileNode::FieldName( int fieldIndex ) const
+{
+	for ( int gridIndex = 0 ; gridIndex < NumGrids() ; gridIndex++ )
+	{
+		if ( fieldIndex < Grid( gridIndex )->NumFields() )
+		{
+			return Grid( gridIndex )->FieldName( fieldIndex );
+		}
+
+		fieldIndex -= Grid( gridIndex )->NumFields();
+	}
+
+	return std::string();
+}
+
+
+
 std::stringlist hdfFileNode::FieldNameList() const
 {
 	std::stringlist fieldNameList;
 
 	for ( int fieldIndex = 0 ; fieldIndex < NumFields() ; ++fieldIndex )
 	{
-		fieldNameList.push_back( Field( fieldIndex )->Name() );
+		fieldNameList.push_back( FieldName( fieldIndex ) );
 	}
 
 	return fieldNameList;
@@ -272,22 +385,21 @@ std::stringlist hdfFileNode::FieldNameList() const
 
 int hdfFileNode::FieldIndex( std::string fieldName ) const
 {
-	int fieldIndex;
+	int firstIndex = 0;
 
-	for ( fieldIndex = 0 ; fieldIndex < NumFields() ; fieldIndex++ )
+	for ( int gridIndex = 0 ; gridIndex < NumGrids() ; gridIndex++ )
 	{
-		if ( fieldName == Field( fieldIndex )->Name() )
+		int fieldIndex = Grid( gridIndex )->FieldIndex( fieldName );
+
+		if ( fieldIndex >= 0 )
 		{
-			break;
+			return firstIndex + fieldIndex;
 		}
-	}
 
-	if ( fieldIndex >= NumFields() )
-	{
-		fieldIndex = -1;
+		firstIndex += Grid( gridIndex )->NumFields();
 	}
 
-	return fieldIndex;
+	return -1;
 }
 
 
@@ -475,57 +587,13 @@ bool hdfFileNode::Load( std::string fileName )
 
 
 
-			uint8 blockDataBuffer[ sizeof( uint32 ) + sizeof( uint8 ) + 4 * sizeof( float64 ) + sizeof( uint8 ) ];
-			for ( int index = 0 ; index < NumRecords ; index++ )
+			// read all records at once, packed one after the other
+			std::vector< uint8 > records( std::max( NumRecords * DataSize, int32( 1 ) ) );
+			status = VSread( dataID, &records[ 0 ], NumRecords, FULL_INTERLACE );
+			if ( status != NumRecords || ! DecodeBlockRecords( &records[ 0 ], NumRecords, DataSize, blockList ) )
 			{
-				status = VSread( dataID, blockDataBuffer, 1, InterlaceMode );
-				if ( status == FAIL )
-				{
-					printf( "couldn't read block data\n" );
-					return false;
-				}
-
-				uint8 *readData = blockDataBuffer;
-				double coord;
-
-                // block index
-				int32 blockIndex;
-				memcpy( &blockIndex, readData, sizeof( uint32 ) );
-				readData += sizeof( uint32 );
-
-                // make room for new blocks
-				if ( int( blockList.size() ) <= blockIndex )
-				{
-					blockList.resize( blockIndex + 1 );
-				}
-
-                // ocean flag
-				memcpy( &blockList[ blockIndex ].oceanFlag, readData, sizeof( uint8 ) );
-				readData += sizeof( uint8 );
-
-                // block left
-				memcpy( &coord, readData, sizeof( float64 ) );
-				readData += sizeof( float64 );
-				blockList[ blockIndex ].bounds.setLeft( coord );
-
-                // block top
-				memcpy( &coord, readData, sizeof( float64 ) );
-				readData += sizeof( float64 );
-				blockList[ blockIndex ].bounds.setTop( coord );
-
-                // block right
-				memcpy( &coord, readData, sizeof( float64 ) );
-				readData += sizeof( float64 );
-				blockList[ blockIndex ].bounds.setRight( coord );
-
-                // block bottom
-				memcpy( &coord, readData, sizeof( float64 ) );
-				readData += sizeof( float64 );
-				blockList[ blockIndex ].bounds.setBottom( coord );
-
-                // data flag
-				memcpy( &blockList[ blockIndex ].dataFlag, readData, sizeof( uint8 ) );
-				readData += sizeof( uint8 );
+				printf( "couldn't read block data\n" );
+				return false;
 			}
 
 			blockRect = blockList[ StartBlock() ].bounds;
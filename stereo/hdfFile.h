@@ -5,6 +5,7 @@
 #include <HdfEosDef.h>
 
 #include <list>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -12,6 +13,12 @@
 #include "ptr.h"
 #include "stringaux.h"
 
+// HDF4 and HDF-EOS keep global state and are not thread safe.
+// Library calls that may run outside of the main thread must hold this lock.
+std::mutex & hdfLibraryMutex();
+
+
+
 class hdfBlockData
 {
 public:
@@ -69,6 +76,7 @@ public:
 
 	int NumFields() const;
 	ptr<hdfFieldNode> Field( int fieldIndex ) const;
+	std::string FieldName( int fieldIndex ) const;
 	std::stringlist FieldNameList() const;
 
 	int FieldIndex( std::string fieldName ) const;
@@ -21,7 +21,10 @@ bounds( 0, 0, 0, 0 ),
 scale( 1.0 ),
 solarIrradiance( 0.0 ),
 solarDistance( 0.0 ),
-fieldList()
+fieldNameList(),
+fieldIndexMap(),
+fieldList(),
+fieldFailed()
 {
 	memset( projectionParameters, 0, sizeof( projectionParameters ) );
 }
@@ -41,7 +44,7 @@ bool hdfGridNode::CheckDependencies() const
 
 	while ( currentField != fieldList.end() )
 	{
-		if ( (*currentField).Count() > 1 )
+		if ( ! (*currentField).IsNull() && (*currentField).Count() > 1 )
 		{
 			return true;
 		}
@@ -163,36 +166,30 @@ double hdfGridNode::SolarDistance() const
 
 int hdfGridNode::NumFields() const
 {
-	return int( fieldList.size() );
+	return int( fieldNameList.size() );
 }
 
 
 
-ptr<hdfFieldNode> hdfGridNode::Field( int fieldIndex ) const
+std::string hdfGridNode::FieldName( int fieldIndex ) const
 {
-	return ( ( fieldIndex >= 0 ) && ( fieldIndex < NumFields() ) ) ? ( fieldList[ fieldIndex ] ) : ( 0 );
+	return ( ( fieldIndex >= 0 ) && ( fieldIndex < NumFields() ) ) ? ( fieldNameList[ fieldIndex ] ) : ( std::string() );
 }
 
 
 
-int hdfGridNode::FieldIndex( std::string fieldName ) const
+ptr<hdfFieldNode> hdfGridNode::Field( int fieldIndex ) const
 {
-	int fieldIndex;
+	return ( ( fieldIndex >= 0 ) && ( fieldIndex < NumFields() ) ) ? ( LoadField( fieldIndex ) ) : ( 0 );
+}
 
-	for ( fieldIndex = 0 ; fieldIndex < NumFields() ; fieldIndex++ )
-	{
-		if ( fieldName == Field( fieldIndex )->Name() )
-		{
-			break;
-		}
-	}
 
-	if ( fieldIndex >= NumFields() )
-	{
-		fieldIndex = -1;
-	}
 
-	return fieldIndex;
+int hdfGridNode::FieldIndex( std::string fieldName ) const
+{
+	std::unordered_map< std::string, int >::const_iterator found = fieldIndexMap.find( fieldName );
+
+	return ( found != fieldIndexMap.end() ) ? ( found->second ) : ( -1 );
 }
 
 
@@ -204,11 +201,49 @@ ptr<hdfFieldNode> hdfGridNode::Field( std::string fieldName ) const
 
 
 
+ptr<hdfFieldNode> hdfGridNode::LoadField( int fieldIndex ) const
+{
+	std::lock_guard<std::mutex> guard( hdfLibraryMutex() );
+
+	if ( fieldList[ fieldIndex ].IsNull() && ! fieldFailed[ fieldIndex ] )
+	{
+		hdfGridNode * grid = const_cast<hdfGridNode *>( this );
+
+		// leave the grid as it was found
+		bool wasOpen = ( Handle() != FAIL );
+
+		if ( grid->Open() )
+		{
+			ptr<hdfFieldNode> theField = new hdfFieldNode( grid );
+
+			if ( theField->Load( fieldNameList[ fieldIndex ] ) )
+			{
+				fieldList[ fieldIndex ] = theField;
+			}
+
+			if ( ! wasOpen )
+			{
+				grid->Close();
+			}
+		}
+
+		if ( fieldList[ fieldIndex ].IsNull() )
+		{
+			printf( "failed to load field %s of grid %s in %s\n", fieldNameList[ fieldIndex ].c_str(), Name().c_str(), FileName().c_str() );
+			fieldFailed[ fieldIndex ] = true;
+		}
+	}
+
+	return fieldList[ fieldIndex ];
+}
+
+
+
 bool hdfGridNode::Open()
 {
 	if ( Handle() == FAIL )
 	{
-		handle = GDattach( File()->ValidHandle(), (char*)Name().c_str() );
+		handle = GDattach( parentFile->ValidHandle(), (char*)Name().c_str() );
 
 		if ( Handle() == FAIL )
 		{
@@ -302,8 +337,6 @@ bool hdfGridNode::Load( std::string gridName )
 
 
 
-	std::stringlist fieldNameList;
-
     // read the name from each field
 	{
 		char *fieldNamesRaw = new char [ fieldNamesLength + 1 ];
@@ -328,27 +361,19 @@ bool hdfGridNode::Load( std::string gridName )
 	}
 
 
-	bool retVal = true;
-
-    // create the fields one at a time
+    // index the fields by name, their metadata is read when they are first used
+	fieldIndexMap.clear();
 	for ( int fieldIndex = 0; fieldIndex < numFields; fieldIndex++ )
 	{
-		ptr<hdfFieldNode> theField = new hdfFieldNode( this );
-
-		if ( theField->Load( fieldNameList[ fieldIndex ] ) )
-		{
-			fieldList.push_back( theField );
-		}
-		else
-		{
-			retVal = false;
-		}
+		fieldIndexMap[ fieldNameList[ fieldIndex ] ] = fieldIndex;
 	}
+	fieldList.assign( numFields, ptr<hdfFieldNode>() );
+	fieldFailed.assign( numFields, false );
 
     // close the grid
 	Close();
 
-	return retVal;
+	return true;
 }
 
 
@@ -356,6 +381,9 @@ bool hdfGridNode::Load( std::string gridName )
 void hdfGridNode::Destroy()
 {
 	fieldList.clear();
+	fieldFailed.clear();
+	fieldIndexMap.clear();
+	fieldNameList.clear();
 }
 
 
@@ -390,6 +418,11 @@ void hdfGridNode::Print( int indent ) const
 
 	for ( int fieldIndex = 0 ; fieldIndex < NumFields() ; fieldIndex++ )
 	{
-		Field( fieldIndex )->Print( indent + 4 );
+		ptr<hdfFieldNode> field = Field( fieldIndex );
+
+		if ( ! field.IsNull() )
+		{
+			field->Print( indent + 4 );
+		}
 	}
 }
@@ -4,6 +4,8 @@
 #include <hdf.h>
 #include <HdfEosDef.h>
 
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "ptr.h"
@@ -48,6 +50,7 @@ public:
 	double SolarDistance() const;
 
 	int NumFields() const;
+	std::string FieldName( int index ) const;
 	ptr<hdfFieldNode> Field( int index ) const;
 
 	int FieldIndex( std::string fieldName ) const;
@@ -56,6 +59,8 @@ public:
 	bool Open();
 	bool Close();
 
+	// reads the grid's metadata and lists its fields, returns false if the grid can not be read
+	// a field's own metadata is read when it is first used, Field() returns null for a field that failed
 	bool Load( std::string gridName );
 	void Destroy();
 
@@ -63,26 +68,30 @@ public:
 
 	// ancestor access functions ( file )
 
-	std::string FileName() const { return File()->Name(); }
+	std::string FileName() const { return parentFile->Name(); }
 
-	int StartBlock() const { return File()->StartBlock(); }
-	int EndBlock() const { return File()->EndBlock(); }
-	int NumBlocks() const { return File()->NumBlocks(); }
+	int StartBlock() const { return parentFile->StartBlock(); }
+	int EndBlock() const { return parentFile->EndBlock(); }
+	int NumBlocks() const { return parentFile->NumBlocks(); }
 
-	const hdfRect & BlockRect( int blockIndex ) const { return File()->BlockRect( blockIndex ); }
+	const hdfRect & BlockRect( int blockIndex ) const { return parentFile->BlockRect( blockIndex ); }
 
-	hdfPolygon BlockPolygon( int blockIndex ) const { return File()->BlockPolygon( blockIndex ); }
-	std::list<hdfPolygon> BlockPolygonList() const { return File()->BlockPolygonList(); }
+	hdfPolygon BlockPolygon( int blockIndex ) const { return parentFile->BlockPolygon( blockIndex ); }
+	std::list<hdfPolygon> BlockPolygonList() const { return parentFile->BlockPolygonList(); }
 
-	int PathNumber() const { return File()->PathNumber(); }
+	int PathNumber() const { return parentFile->PathNumber(); }
 
-	int CameraNumber() const { return File()->CameraNumber(); }
-	std::string CameraName() const { return File()->CameraName(); }
+	int CameraNumber() const { return parentFile->CameraNumber(); }
+	std::string CameraName() const { return parentFile->CameraName(); }
 
-	int OrbitNumber() const { return File()->OrbitNumber(); }
+	int OrbitNumber() const { return parentFile->OrbitNumber(); }
 
 protected:
 
+	// reads the metadata of a field the first time it is asked for
+	// a field that fails is reported once and not read again
+	ptr<hdfFieldNode> LoadField( int fieldIndex ) const;
+
 	hdfFileNode * parentFile;
 	int32 handle;
 
@@ -102,7 +111,11 @@ protected:
 	double solarIrradiance;
 	double solarDistance;
 
-	std::vector< ptr< hdfFieldNode > > fieldList;
+	// fields are listed by name when the grid is loaded, and loaded on first use
+	std::stringlist fieldNameList;
+	std::unordered_map< std::string, int > fieldIndexMap;
+	mutable std::vector< ptr< hdfFieldNode > > fieldList;
+	mutable std::vector< bool > fieldFailed;
 };
 
 
@@ -267,6 +267,21 @@ _misr_print_help_msg(const char *prog)
    printf("\t[file_prefix]  - An optional file name prefix used in search for *.hdf files.\n");
    printf("\t                 The default value used is : MISR_AM1_GRP_ELLIPSOID_GM_\n");
    printf("\n");
+   printf("Environment :\n");
+   printf("\tMISR_PRELOAD_MB - Texture memory in megabytes used to load the next orbit\n");
+   printf("\t                  ahead of the orbit boundary. 0 disables it. Default : 256\n");
+   printf("\tMISR_TEXTURE_MB - Texture memory in megabytes used for the blocks of the\n");
+   printf("\t                  current orbit, the least wanted blocks make room. Default : 1024\n");
+   printf("\tMISR_RADIANCE_CACHE_MB - Memory in megabytes used to keep raw radiance so\n");
+   printf("\t                  brightness changes do not read the files again. Default : 512\n");
+   printf("\tMISR_DATA_CACHE_MB - Memory in megabytes shared by the data sources to keep\n");
+   printf("\t                  field blocks they have read. Default : 256\n");
+   printf("\tMISR_BLOCK_CACHE_DIR - Directory keeping decoded blocks so orbits open again\n");
+   printf("\t                  without decompressing the files. Empty disables it.\n");
+   printf("\t                  Default : %s\n", PACKAGE_DATA_DIR "/cache");
+   printf("\tMISR_BLOCK_CACHE_MB - Disk space in megabytes for the block cache, the least\n");
+   printf("\t                  recently used blocks make room. 0 disables it. Default : 4096\n");
+   printf("\n");
    printf("Usage example :\n");
    printf("\t[1] misr_stereo ../data/ AA AN\n");
    printf("\t[2] misr_stereo ../data/ AA AN THIS_IS_MY_HDF_FILE_PREFIX\n");
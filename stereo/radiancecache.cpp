@@ -0,0 +1,79 @@
+#include "radiancecache.h"
+
+radianceCache::radianceCache( double maxBytes )
+:
+bytes( 0.0 ),
+maxBytes( maxBytes )
+{
+
+}
+
+bool radianceCache::Find( const viewport * source, int blockIndex, matrix<unsigned short> channels[3] )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    std::map<key, std::list<entry>::iterator>::iterator found = index.find( key( source, blockIndex ) );
+
+    if ( found == index.end() )
+    {
+        return false;
+    }
+
+    // move to the front of the recently used list
+    entries.splice( entries.begin(), entries, found->second );
+
+    for ( int i = 0 ; i < 3 ; i++ )
+    {
+        channels[i] = found->second->channels[i];
+    }
+
+    return true;
+}
+
+void radianceCache::Insert( const viewport * source, int blockIndex, const matrix<unsigned short> channels[3] )
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    key id( source, blockIndex );
+
+    if ( index.find( id ) != index.end() || maxBytes <= 0.0 )
+    {
+        return;
+    }
+
+    entries.push_front( entry() );
+    entry & newEntry = entries.front();
+
+    newEntry.id = id;
+    newEntry.bytes = 0.0;
+
+    for ( int i = 0 ; i < 3 ; i++ )
+    {
+        newEntry.channels[i] = channels[i];
+        newEntry.bytes += double( channels[i].numRows() ) * channels[i].numCols() * sizeof( unsigned short );
+    }
+
+    index[ id ] = entries.begin();
+    bytes += newEntry.bytes;
+
+    Trim();
+}
+
+void radianceCache::Clear()
+{
+    std::lock_guard<std::mutex> guard( lock );
+
+    entries.clear();
+    index.clear();
+    bytes = 0.0;
+}
+
+void radianceCache::Trim()
+{
+    while ( bytes > maxBytes && ! entries.empty() )
+    {
+        bytes -= entries.back().bytes;
+        index.erase( entries.back().id );
+        entries.pop_back();
+    }
+}
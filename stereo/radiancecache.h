@@ -0,0 +1,56 @@
+#ifndef RADIANCECACHE_H_INCLUDED
+#define RADIANCECACHE_H_INCLUDED
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "matrix.h"
+
+class viewport;
+
+// radianceCache
+// + keeps the raw radiance channels of recently read blocks in memory
+// + least recently used blocks are evicted once the byte limit is reached
+// + safe to use from several threads at once
+class radianceCache
+{
+public:
+
+    radianceCache( double maxBytes );
+
+    // copies the channels of a cached block into channels, returns false if the block is not cached
+    bool Find( const viewport * source, int blockIndex, matrix<unsigned short> channels[3] );
+
+    // stores a copy of the channels of a block
+    void Insert( const viewport * source, int blockIndex, const matrix<unsigned short> channels[3] );
+
+    // drops all cached blocks
+    void Clear();
+
+protected:
+
+    typedef std::pair<const viewport *, int> key;
+
+    struct entry
+    {
+        key id;
+        matrix<unsigned short> channels[3];
+        double bytes;
+    };
+
+    // evicts least recently used blocks until the cache fits in maxBytes
+    void Trim();
+
+    std::mutex lock;
+
+    // most recently used first
+    std::list<entry> entries;
+    std::map<key, std::list<entry>::iterator> index;
+
+    double bytes;
+    double maxBytes;
+};
+
+#endif // RADIANCECACHE_H_INCLUDED
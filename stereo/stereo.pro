@@ -21,6 +21,13 @@ TARGET = misr-stereo
 DEPENDPATH += $$MISRDIR/src
 INCLUDEPATH += $$MISRDIR/src
 
+SOURCES += blockfilecache.cpp
+SOURCES += blockloader.cpp
+SOURCES += blockrenderer.cpp
+SOURCES += blocktextures.cpp
+SOURCES += colorize.cpp
+SOURCES += datablockcache.cpp
+SOURCES += glextensions.cpp
 SOURCES += glutaux.cpp
 SOURCES += ../src/hdfDataNode.cpp
 SOURCES += hdfDataSource.cpp
@@ -34,11 +41,14 @@ SOURCES += ../src/stringaux.cpp
 SOURCES += viewport.cpp
 SOURCES += misr_orbits.cpp
 SOURCES += misr_png_helper.cpp
+SOURCES += radiancecache.cpp
 
 TEMPLATE     = app
 CONFIG -= qt
 CONFIG += warn_on stl opengl thread release
 
+QMAKE_CXXFLAGS += -std=c++0x
+
 LIBS        += -L../lib
 
 unix:!macx: LIBS += -lX11 -lXi -lXmu
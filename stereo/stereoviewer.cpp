@@ -1,4 +1,5 @@
 #include <iostream>
+#include <stdlib.h>
 
 #include <glutaux.h>
 #include "help.h"
@@ -15,12 +16,55 @@
 
 using namespace std;
 
+// how far ahead of the pan, in seconds, blocks are favoured for loading
+static const double s_prefetch_lead_time = 4.0;
+
+// pan speed in blocks per second below which the view is considered still
+static const double s_pan_dead_band = 0.05;
+
+// time in seconds for the pan speed to fall to a third once the view stops moving
+static const double s_pan_decay_time = 0.25;
+
+// a new orbit is entered this many blocks before its last block
+static const int s_arrival_offset = 20;
+
+// default texture memory for preloading the next orbit in megabytes
+static const double s_preload_mb = 256.0;
+
+// default texture memory for the blocks of the current orbit in megabytes
+static const double s_texture_mb = 1024.0;
+
+// default memory for raw radiance kept to colorize blocks again in megabytes
+static const double s_radiance_cache_mb = 512.0;
+
 stereoViewer::stereoViewer(MISR_Orbits *orbits) :
    m_viewports(),
    m_current_view(-1),
    m_orbits(orbits),
    m_show_globe(false)
 {
+   double radiance_cache = s_radiance_cache_mb * 1024.0 * 1024.0;
+   const char *radiance_cache_mb = getenv("MISR_RADIANCE_CACHE_MB");
+   if (radiance_cache_mb)
+     radiance_cache = atof(radiance_cache_mb) * 1024.0 * 1024.0;
+
+   loader = new blockLoader(radiance_cache);
+   blockVelocity = 0.0;
+   moveVelocity = 0.0;
+   lastMoveTime = 0;
+   scheduleValid = false;
+   preloadView = -1;
+
+   preloadBudget = s_preload_mb * 1024.0 * 1024.0;
+   const char *preload_mb = getenv("MISR_PRELOAD_MB");
+   if (preload_mb)
+     preloadBudget = atof(preload_mb) * 1024.0 * 1024.0;
+
+   textureBudget = s_texture_mb * 1024.0 * 1024.0;
+   const char *texture_mb = getenv("MISR_TEXTURE_MB");
+   if (texture_mb)
+     textureBudget = atof(texture_mb) * 1024.0 * 1024.0;
+
    if (!orbits)
      return;
 
@@ -107,6 +151,9 @@ stereoViewer::stereoViewer(MISR_Orbits *orbits) :
 
 stereoViewer::~stereoViewer()
 {
+   // stop the workers before the viewports they read from go away
+   delete loader;
+
    for (unsigned int i = 0; i < m_viewports.size(); i++)
      {
         stereoViewer::viewport_set *s = m_viewports[i];
@@ -258,19 +305,6 @@ stereoViewer::switch_current_view(unsigned int view)
 
    if ((int)view != this->m_current_view)
      { 
-        
-        if (s->v1)
-          {
-             minBlock = s->v1->MinBlock();
-             maxBlock = s->v1->MaxBlock();
-          } 
-        
-        if (s->v2)
-          {
-             minBlock = max(minBlock, s->v2->MinBlock());
-             maxBlock = min(maxBlock, s->v2->MaxBlock());
-          } 
-
         if (this->m_current_view >= 0)
           {
              // prevent texture deallocation during a startup.
@@ -280,9 +314,37 @@ stereoViewer::switch_current_view(unsigned int view)
              s2->v1->DestroyTextures(minBlock, maxBlock);
              s2->v2->DestroyTextures(minBlock, maxBlock);
           } 
-        
-        s->v1->AllocTextures(minBlock, maxBlock);
-        s->v2->AllocTextures(minBlock, maxBlock); 
+
+        block_range(view, minBlock, maxBlock);
+
+        if ((int)view == preloadView)
+          {
+             // the orbit was loaded ahead of time, take its textures over as they are.
+             // blocks of the old orbit still in the loader are dropped on arrival.
+             blockTextureValid.swap(preloadTextureValid);
+             blockTextureRequested.swap(preloadTextureRequested);
+             preloadView = -1;
+
+             // the preload kept to its budget, the current orbit may use the full one
+             int capacity = BudgetBlocks(view, textureBudget);
+             s->v1->setMaxTextures(capacity);
+             s->v2->setMaxTextures(capacity);
+             scheduleValid = false;
+          }
+        else
+          {
+             DropPreload();
+
+             int capacity = BudgetBlocks(view, textureBudget);
+             s->v1->AllocTextures(minBlock, maxBlock, capacity);
+             s->v2->AllocTextures(minBlock, maxBlock, capacity); 
+
+             blockTextureValid.resize( maxBlock + 1 );
+             blockTextureRequested.resize( maxBlock + 1 );
+             ClearBlockTextures(); 
+          }
+
+        blockTextureStale.assign( maxBlock + 1, false );
         
         blockToWorld.clear(); 
         
@@ -290,9 +352,6 @@ stereoViewer::switch_current_view(unsigned int view)
           { 
              blockToWorld.insert(make_pair(double(block), s->v1->BlockCenter(block)));
           } 
-        
-        blockTextureValid.resize( maxBlock + 1 );
-        ClearBlockTextures(); 
      }
    
 
@@ -300,7 +359,7 @@ stereoViewer::switch_current_view(unsigned int view)
    pixelsPerMeter = s->v1->PixelsPerMeter(); 
 
    // move to block closer to pole
-   blockPosition = vec2d(blockToWorld.KeyMax()-20, 0); 
+   blockPosition = vec2d(blockToWorld.KeyMax()-s_arrival_offset, 0); 
    worldPosition = BlockToWorld( blockPosition ); 
    
    blockSize = s->v1->BlockSize(); 
@@ -427,7 +486,7 @@ stereoViewer::SpecialKeyPress( int key )
          if (maxVal > 50 ) 
            maxVal -= 50;
          
-         ClearBlockTextures(); 
+         RestretchBlockTextures(); 
          glutPostRedisplay();
       } 
     else if ( key == GLUT_KEY_DOWN )
@@ -435,7 +494,7 @@ stereoViewer::SpecialKeyPress( int key )
          if( maxVal < 1500 ) 
            maxVal += 50;
          
-         ClearBlockTextures();
+         RestretchBlockTextures();
          glutPostRedisplay();
       }
 printf("maxVal %f\n",maxVal);
@@ -465,25 +524,35 @@ stereoViewer::Resize( const vec2d & newSize )
 int 
 stereoViewer::Update()
 {
-   int next;
+   blockLoader::result block;
 
-   
-   if ( buttonsPressed == 0 )
-     { 
-        next = NextBlockToLoad(); 
-        
-        if ( next >= minBlock && next <= maxBlock ) 
-          {
-             MakeBlockTexture( next );
-             
-             if (next >= minViewBlock && next <= maxViewBlock ) 
-               { 
-                  glutPostRedisplay(); 
-               } 
-          } 
-        else if (next < 0) 
-          { 
-          } 
+   // upload at most one finished block per call to keep drawing responsive,
+   // and none while a button is held so dragging stays smooth, the workers keep decoding meanwhile
+   if (buttonsPressed == 0 && loader->Collect(block))
+     {
+        CreateTexture(block);
+     }
+
+   // the pan slows down once the view stops moving
+   double idle = 0.001 * (glutGet(GLUT_ELAPSED_TIME) - lastMoveTime);
+   blockVelocity = moveVelocity * exp(-idle / s_pan_decay_time);
+   if (fabs(blockVelocity) <= s_pan_dead_band)
+     blockVelocity = 0.0;
+
+   int direction = 0;
+   if (blockVelocity > s_pan_dead_band)
+     direction = 1;
+   else if (blockVelocity < -s_pan_dead_band)
+     direction = -1;
+
+   // rank the queue again whenever the view moves or changes direction
+   if (!scheduleValid ||
+       minViewBlock != scheduledMinBlock ||
+       maxViewBlock != scheduledMaxBlock ||
+       direction != scheduledDirection)
+     {
+        scheduledDirection = direction;
+        ScheduleBlocks();
      }
 
    return 0;
@@ -492,27 +561,49 @@ stereoViewer::Update()
 void
 stereoViewer::next_orbit()
 { 
-   if (this->m_current_view + 1 >= (int)this->m_viewports.size())
-     {
-        this->switch_current_view(0);
-     }
-   else
-     {
-        this->switch_current_view(this->m_current_view + 1);
-     }
+   this->switch_current_view(this->next_view());
 }
 
 void
 stereoViewer::prev_orbit()
+{ 
+   this->switch_current_view(this->prev_view());
+}
+
+int
+stereoViewer::next_view() const
+{ 
+   if (this->m_current_view + 1 >= (int)this->m_viewports.size())
+     return 0;
+
+   return this->m_current_view + 1;
+}
+
+int
+stereoViewer::prev_view() const
 { 
    if (this->m_current_view - 1 <= 0)
+     return this->m_viewports.size() - 1;
+
+   return this->m_current_view - 1;
+}
+
+void
+stereoViewer::block_range(unsigned int view, int &first, int &last) const
+{
+   stereoViewer::viewport_set *s = this->m_viewports[view];
+
+   if (s->v1)
      {
-        this->switch_current_view(this->m_viewports.size() - 1);
-     }
-   else
+        first = s->v1->MinBlock();
+        last = s->v1->MaxBlock();
+     } 
+
+   if (s->v2)
      {
-        this->switch_current_view(this->m_current_view - 1);
-     }
+        first = max(first, s->v2->MinBlock());
+        last = min(last, s->v2->MaxBlock());
+     } 
 }
 
 void 
@@ -645,65 +736,137 @@ stereoViewer::draw_globe()
 //printf("maxViewBlock: %i, maxBlock: %i\n", maxViewBlock, maxBlock);
 }
 
-void stereoViewer::MakeBlockTexture( int blockIndex )
+void stereoViewer::MakeBlockTexture( int blockIndex, double priority )
 {
-    if ( ! blockTextureValid[ blockIndex ] )
+    if ( ( ! blockTextureValid[ blockIndex ] || blockTextureStale[ blockIndex ] ) && ! blockTextureRequested[ blockIndex ] )
     {
-        blockTextureValid[ blockIndex ] = true;
+        blockTextureRequested[ blockIndex ] = true;
 
-        stereoViewer::viewport_set *s = NULL;
-        s = this->m_viewports[this->m_current_view];
-        if (!s)
-          return; 
-        
-        unsigned char * pixel1 = NULL;
-        unsigned char * pixel2 = NULL;
-        
-        if (s->v1) 
-          { 
-             pixel1 = & (s->v1->BlockImage(blockIndex, maxVal))[0];
-          }
+        SubmitBlock( this->m_current_view, blockIndex, priority );
+    }
+}
 
-        if (s->v2) 
-          {
-             pixel2 = & (s->v2->BlockImage(blockIndex, maxVal))[0];
-          }
-        
-        
-        unsigned char * pixel1end = NULL;
-        
-        if (s->v1)
-          { 
-             std::vector<unsigned char> & image1 = s->v1->BlockImage(blockIndex, maxVal);
-             pixel1end = & image1[ image1.size() ]; 
-          }
-        
-        if (pixel2 && pixel1 && pixel1end)
-          { 
-             while ( pixel1 < pixel1end ) 
-               { 
-                  if ( pixel1[3] == 0 || pixel2[3] == 0 ) 
-                    { 
-                       pixel1[0] = 0; 
-                       pixel1[1] = 0; 
-                       pixel1[2] = 0; 
-                       
-                       pixel2[0] = 0;
-                       pixel2[1] = 0;
-                       pixel2[2] = 0;
-                    } 
-                  
-                  pixel1 += 4;
-                  pixel2 += 4;
-               }
-          } 
-        
-        if (s->v1) 
-          s->v1->CreateTextureFromImage( blockIndex );
+void stereoViewer::SubmitBlock( int view, int blockIndex, double priority )
+{
+    stereoViewer::viewport_set *s = NULL;
+    s = this->m_viewports[view];
+    if (!s)
+      return; 
+
+    blockLoader::request block;
+    block.view = view;
+    block.blockIndex = blockIndex;
+    block.v1 = s->v1;
+    block.v2 = s->v2;
+    block.maxVal = maxVal;
+    block.priority = priority;
+
+    loader->Submit( block );
+}
+
+void stereoViewer::CreateTexture( blockLoader::result & block )
+{
+    const int blockIndex = block.source.blockIndex;
+    const int view = block.source.view;
+
+    // blocks of an orbit that was left or of a dropped preload have no textures anymore
+    if ( view != this->m_current_view && view != preloadView )
+      return;
+
+    if ( view == this->m_current_view )
+      MakeTextureRoom( blockIndex );
 
-        if (s->v2) 
-          s->v2->CreateTextureFromImage( blockIndex ); 
+    bool uploaded = true;
+
+    if ( block.source.v1 ) 
+      uploaded = block.source.v1->CreateTextureFromImage( blockIndex, block.image1 );
+
+    if ( block.source.v2 && uploaded ) 
+      uploaded = block.source.v2->CreateTextureFromImage( blockIndex, block.image2 ); 
+
+    if ( ! uploaded )
+    {
+        // no room left, the block is asked for again when it ranks high enough
+        if ( block.source.v1 )
+          block.source.v1->ReleaseTexture( blockIndex );
+
+        if ( block.source.v2 )
+          block.source.v2->ReleaseTexture( blockIndex );
+
+        if ( view == preloadView )
+        {
+            preloadTextureValid[ blockIndex ] = false;
+            preloadTextureRequested[ blockIndex ] = false;
+            return;
+        }
+
+        blockTextureValid[ blockIndex ] = false;
+        blockTextureRequested[ blockIndex ] = false;
+        blockTextureStale[ blockIndex ] = false;
+        return;
     }
+
+    if ( view == preloadView )
+    {
+        preloadTextureValid[ blockIndex ] = true;
+        preloadTextureRequested[ blockIndex ] = false;
+        return;
+    }
+
+    blockTextureValid[ blockIndex ] = true;
+    blockTextureRequested[ blockIndex ] = false;
+    blockTextureStale[ blockIndex ] = false;
+
+    if ( blockIndex >= minViewBlock && blockIndex <= maxViewBlock ) 
+      { 
+         glutPostRedisplay(); 
+      } 
+}
+
+void 
+stereoViewer::MakeTextureRoom( int blockIndex )
+{
+    stereoViewer::viewport_set *s = this->m_viewports[this->m_current_view];
+
+    bool full = false;
+
+    if ( s->v1 && ! s->v1->HasTexture( blockIndex ) && s->v1->NumTextures() >= s->v1->MaxTextures() )
+      full = true;
+
+    if ( s->v2 && ! s->v2->HasTexture( blockIndex ) && s->v2->NumTextures() >= s->v2->MaxTextures() )
+      full = true;
+
+    if ( ! full )
+      return;
+
+    int victim = -1;
+    double victimPriority = BlockPriority( blockIndex );
+
+    for ( int block = minBlock ; block <= maxBlock ; block++ )
+    {
+        if ( ( s->v1 && s->v1->HasTexture( block ) ) || ( s->v2 && s->v2->HasTexture( block ) ) )
+        {
+            double priority = BlockPriority( block );
+
+            if ( priority > victimPriority )
+            {
+                victim = block;
+                victimPriority = priority;
+            }
+        }
+    }
+
+    if ( victim < 0 )
+      return;
+
+    if ( s->v1 )
+      s->v1->ReleaseTexture( victim );
+
+    if ( s->v2 )
+      s->v2->ReleaseTexture( victim );
+
+    blockTextureValid[ victim ] = false;
+    blockTextureStale[ victim ] = false;
 }
 
 void 
@@ -711,41 +874,81 @@ stereoViewer::DrawBlocks(unsigned int view)
 {
     glEnable( GL_TEXTURE_2D );
 
-    for (int block = minViewBlock ; block <= maxViewBlock ; block++) 
+    stereoViewer::viewport_set *s = NULL;
+    s = this->m_viewports[this->m_current_view];
+    if (s)
       { 
-         //MakeBlockTexture( block );
-         if ( blockTextureValid[ block ] ) 
-           { 
-              stereoViewer::viewport_set *s = NULL;
-              s = this->m_viewports[this->m_current_view];
-              if (s)
-                { 
-                   if (view == 0 && s->v1)
-                     s->v1->DrawBlock(block);
-
-                   if (view == 1 && s->v2)
-                     s->v2->DrawBlock(block);
-                } 
-           }
-      }    
+         if (view == 0 && s->v1)
+           s->v1->DrawBlocks(minViewBlock, maxViewBlock, blockTextureValid);
+
+         if (view == 1 && s->v2)
+           s->v2->DrawBlocks(minViewBlock, maxViewBlock, blockTextureValid);
+      } 
+
     glDisable( GL_TEXTURE_2D );
 }
 
 void 
 stereoViewer::ClearBlockTextures()
 {
+    loader->Cancel();
+
     fill( blockTextureValid.begin(), blockTextureValid.end(), false );
+    fill( blockTextureRequested.begin(), blockTextureRequested.end(), false );
+
+    fill( preloadTextureValid.begin(), preloadTextureValid.end(), false );
+    fill( preloadTextureRequested.begin(), preloadTextureRequested.end(), false );
+
+    scheduleValid = false;
+}
+
+void 
+stereoViewer::RestretchBlockTextures()
+{
+    // blocks in progress were colorized with the old stretch
+    loader->Cancel();
+
+    blockTextureStale = blockTextureValid;
+    fill( blockTextureRequested.begin(), blockTextureRequested.end(), false );
+
+    fill( preloadTextureValid.begin(), preloadTextureValid.end(), false );
+    fill( preloadTextureRequested.begin(), preloadTextureRequested.end(), false );
+
+    scheduleValid = false;
 }
 
 void 
 stereoViewer::GoToBlock( int blockIndex )
 {
     MoveTo( vec2d( blockIndex, 0 ) );
+
+    // a jump says nothing about where the user pans next, and the next move starts a new pan
+    blockVelocity = 0.0;
+    moveVelocity = 0.0;
+    lastMoveTime = 0;
+    scheduleValid = false;
 }
 
 void 
 stereoViewer::Move( const vec2d & blockDelta )
 {
+    // only panning measures the speed, a jump's distance is not one
+    int now = glutGet( GLUT_ELAPSED_TIME );
+    double elapsed = 0.001 * ( now - lastMoveTime );
+    lastMoveTime = now;
+
+    if ( elapsed > 0.0 && elapsed < 0.5 )
+    {
+        double speed = blockDelta.x() / elapsed;
+        blockVelocity = 0.8 * blockVelocity + 0.2 * speed;
+    }
+    else
+    {
+        blockVelocity = 0.0;
+    }
+
+    moveVelocity = blockVelocity;
+
     MoveTo( blockPosition + blockDelta );
 }
 
@@ -781,54 +984,203 @@ stereoViewer::UpdateView()
     glutPostRedisplay();
 }
 
-int 
-stereoViewer::NextBlockToLoad()
+void 
+stereoViewer::ScheduleBlocks()
 {
-    int closestLeft = int( blockPosition.x() );
-    while (closestLeft >= minBlock)
-    { 
-       if (!blockTextureValid[ closestLeft ])
-         break; 
-       
-       closestLeft--;
+    scheduleValid = true;
+    scheduledMinBlock = minViewBlock;
+    scheduledMaxBlock = maxViewBlock;
+
+    // blocks that have not started yet are ranked again with the rest
+    vector<blockLoader::request> unqueued;
+    loader->Unqueue( unqueued );
+
+    for ( unsigned int i = 0 ; i < unqueued.size() ; i++ )
+    {
+        if ( unqueued[i].view == this->m_current_view )
+        {
+            blockTextureRequested[ unqueued[i].blockIndex ] = false;
+        }
+        else if ( unqueued[i].view == preloadView )
+        {
+            preloadTextureRequested[ unqueued[i].blockIndex ] = false;
+        }
     }
 
-    int closestRight = int( blockPosition.x() );
-    while ( closestRight <= maxBlock )
+    // only as many blocks as can have textures at once, the most wanted first
+    vector< pair<double,int> > order;
+    for ( int block = minBlock ; block <= maxBlock ; block++ )
     {
-        if ( ! blockTextureValid[ closestRight ] ) break;
-        closestRight++;
+        order.push_back( make_pair( BlockPriority( block ), block ) );
     }
 
-    // if left is bad
-    if ( closestLeft < minBlock || closestLeft > maxBlock )
+    sort( order.begin(), order.end() );
+    order.resize( min( (unsigned int)TextureCapacity(), (unsigned int)order.size() ) );
+
+    for ( unsigned int i = 0 ; i < order.size() ; i++ )
     {
-        // if right is bad
-        if ( closestRight < minBlock || closestRight > maxBlock )
-        {
-            return -1;
-        }
-        else
+        MakeBlockTexture( order[i].second, order[i].first );
+    }
+
+    SchedulePreload();
+}
+
+void 
+stereoViewer::SchedulePreload()
+{
+    // autoscroll and a still view head for the next orbit
+    int view = ( scheduledDirection > 0 ) ? prev_view() : next_view();
+
+    if ( view == this->m_current_view || preloadBudget <= 0.0 )
+    {
+        DropPreload();
+        return;
+    }
+
+    if ( view != preloadView )
+    {
+        DropPreload();
+
+        stereoViewer::viewport_set *s = this->m_viewports[view];
+
+        block_range( view, preloadMinBlock, preloadMaxBlock );
+
+        // textures only for the blocks the budget lets through, the rest come once the orbit is entered
+        int capacity = min( BudgetBlocks( view, preloadBudget ), BudgetBlocks( view, textureBudget ) );
+        s->v1->AllocTextures( preloadMinBlock, preloadMaxBlock, capacity );
+        s->v2->AllocTextures( preloadMinBlock, preloadMaxBlock, capacity );
+
+        preloadTextureValid.assign( preloadMaxBlock + 1, false );
+        preloadTextureRequested.assign( preloadMaxBlock + 1, false );
+        preloadView = view;
+    }
+
+    // as many blocks as the preload has textures for
+    unsigned int budgetBlocks = (unsigned int)this->m_viewports[view]->v1->MaxTextures();
+
+    // switch_current_view() enters the orbit here, load outwards from it
+    int arrival = preloadMaxBlock - s_arrival_offset;
+
+    vector< pair<int,int> > order;
+    for ( int block = preloadMinBlock ; block <= preloadMaxBlock ; block++ )
+    {
+        order.push_back( make_pair( abs( block - arrival ), block ) );
+    }
+
+    sort( order.begin(), order.end() );
+    order.resize( min( budgetBlocks, (unsigned int)order.size() ) );
+
+    for ( unsigned int rank = 0 ; rank < order.size() ; rank++ )
+    {
+        int block = order[rank].second;
+
+        if ( ! preloadTextureValid[ block ] && ! preloadTextureRequested[ block ] )
         {
-            return closestRight;
+            preloadTextureRequested[ block ] = true;
+            SubmitBlock( view, block, PreloadPriority( rank ) );
         }
     }
+}
+
+double 
+stereoViewer::PreloadPriority( int rank ) const
+{
+    double visible = maxViewBlock - minViewBlock + 1;
+
+    // the preloaded orbit continues past the boundary the pan is heading to
+    double boundary = ( scheduledDirection > 0 ) ? maxBlock : minBlock;
+    double distance = fabs( blockPosition.x() - boundary ) + 1 + rank;
+
+    if ( scheduledDirection != 0 )
+    {
+        distance /= 1.0 + fabs( blockVelocity ) * s_prefetch_lead_time;
+    }
+
+    return visible + distance;
+}
+
+void 
+stereoViewer::DropPreload()
+{
+    if ( preloadView < 0 )
+      return;
+
+    stereoViewer::viewport_set *s = this->m_viewports[preloadView];
+
+    s->v1->DestroyTextures( preloadMinBlock, preloadMaxBlock );
+    s->v2->DestroyTextures( preloadMinBlock, preloadMaxBlock );
+
+    preloadTextureValid.clear();
+    preloadTextureRequested.clear();
+    preloadView = -1;
+}
+
+int 
+stereoViewer::BudgetBlocks( unsigned int view, double budget ) const
+{
+    // both eyes of a block as RGBA textures
+    vec2d imageSize = this->m_viewports[view]->v1->BlockImageSize();
+    double blockBytes = 2.0 * 4.0 * imageSize.x() * imageSize.y();
+
+    return int( budget / blockBytes );
+}
+
+int 
+stereoViewer::TextureCapacity() const
+{
+    stereoViewer::viewport_set *s = this->m_viewports[this->m_current_view];
+
+    int capacity = maxBlock - minBlock + 1;
+
+    if ( s->v1 )
+      capacity = min( capacity, s->v1->MaxTextures() );
+
+    if ( s->v2 )
+      capacity = min( capacity, s->v2->MaxTextures() );
+
+    return capacity;
+}
+
+double 
+stereoViewer::BlockPriority( int blockIndex ) const
+{
+    double center = 0.5 * ( minViewBlock + maxViewBlock );
+    double visible = maxViewBlock - minViewBlock + 1;
+
+    // visible blocks from the middle of the screen out
+    if ( blockIndex >= minViewBlock && blockIndex <= maxViewBlock )
+    {
+        return fabs( blockIndex - center );
+    }
+
+    // off screen blocks by their distance from the view, shrunk on the
+    // leading edge and stretched on the trailing edge by the pan speed
+    double distance;
+    bool ahead;
 
-    // if right is bad
-    if ( closestRight < minBlock || closestRight > maxBlock )
+    if ( blockIndex < minViewBlock )
     {
-        return closestLeft;
+        distance = minViewBlock - blockIndex;
+        ahead = blockVelocity < -s_pan_dead_band;
     }
+    else
+    {
+        distance = blockIndex - maxViewBlock;
+        ahead = blockVelocity > s_pan_dead_band;
+    }
+
+    double lead = 1.0 + fabs( blockVelocity ) * s_prefetch_lead_time;
 
-    // pick closest
-    if ( minViewBlock - closestLeft < closestRight - maxViewBlock )
+    if ( ahead )
     {
-        return closestLeft;
+        distance /= lead;
     }
     else
     {
-        return closestRight;
+        distance *= lead;
     }
+
+    return visible + distance;
 }
 
 vec2d 
@@ -6,6 +6,7 @@
 
 #include "vec2.h"
 #include "interpolator.h"
+#include "blockloader.h"
 
 #include "misr_orbits.h"
 
@@ -37,7 +38,8 @@ public:
 
     void Draw();
 
-    void MakeBlockTexture( int blockIndex );
+    // queues a block for decoding on the block loader's worker threads
+    void MakeBlockTexture( int blockIndex, double priority );
 
     /**
      * @brief The functions calls each viewport to draw its blocks.
@@ -49,13 +51,19 @@ public:
 
     void GoToBlock( int blockIndex );
 
+    // pans by blockDelta, tracking the pan speed
     void Move( const vec2d & blockDelta );
 
+    // puts the view at newBlockPosition, leaving the pan speed alone
     void MoveTo( const vec2d & newBlockPosition );
 
     void UpdateView();
 
-    int NextBlockToLoad();
+    // ranks every block that still needs a texture and hands them to the block loader
+    void ScheduleBlocks();
+
+    // lower values load first: visible blocks, then blocks ahead of the pan direction
+    double BlockPriority( int blockIndex ) const;
 
 protected: 
 
@@ -83,13 +91,43 @@ protected:
     void next_orbit();
     void prev_orbit();
 
+    // returns the views next_orbit() and prev_orbit() switch to
+    int next_view() const;
+    int prev_view() const;
+
+    // returns the blocks valid in both eyes of a view
+    void block_range(unsigned int view, int &first, int &last) const;
+
     void draw_globe();
 
 
 
     /****************************/
 
-    void CreateTexture( int blockIndex );
+    // uploads a block decoded by the block loader
+    void CreateTexture( blockLoader::result & block );
+
+    // queues a block of any view for decoding
+    void SubmitBlock( int view, int blockIndex, double priority );
+
+    // picks the orbit the pan is heading into and queues the blocks shown on arrival
+    void SchedulePreload();
+
+    // ranks the preloaded blocks behind the ones left before the orbit boundary
+    double PreloadPriority( int rank ) const;
+
+    // releases the textures of the preloaded orbit
+    void DropPreload();
+
+    // returns how many blocks of a view fit in budget bytes of textures for both eyes
+    int BudgetBlocks( unsigned int view, double budget ) const;
+
+    // returns how many blocks of the current view can have textures at once
+    int TextureCapacity() const;
+
+    // frees the textures of the least wanted block of the current view if every texture is taken
+    // and that block is wanted less than blockIndex
+    void MakeTextureRoom( int blockIndex );
 
     vec2d ScreenToWorld( const vec2d & pos ) const;
     vec2d WorldToScreen( const vec2d & pos ) const;
@@ -108,6 +146,9 @@ protected:
 	
     void ClearBlockTextures();
 
+    // colorizes all blocks again after a stretch change, showing the old textures meanwhile
+    void RestretchBlockTextures();
+
     double maxVal;
     int buttonsPressed;
     double zoomRatio, pixelsPerMeter;
@@ -123,6 +164,33 @@ protected:
     interpolator<double,vec2d> blockToWorld;
     std::string blockInput;
     std::vector<bool> blockTextureValid;
+    std::vector<bool> blockTextureRequested;
+    std::vector<bool> blockTextureStale;
+
+    blockLoader *loader;
+
+    // pan speed along the orbit in blocks per second, smoothed over recent moves
+    // + moveVelocity is the speed at the last move, blockVelocity decays from it while the view is still
+    double blockVelocity;
+    double moveVelocity;
+    int lastMoveTime;
+
+    // view the block loader queue was last ranked for
+    bool scheduleValid;
+    int scheduledMinBlock, scheduledMaxBlock;
+    int scheduledDirection;
+
+    // orbit loaded in the background ahead of an orbit boundary, -1 if none
+    int preloadView;
+    int preloadMinBlock, preloadMaxBlock;
+    std::vector<bool> preloadTextureValid;
+    std::vector<bool> preloadTextureRequested;
+
+    // texture memory allowed for the preloaded orbit in bytes, from MISR_PRELOAD_MB
+    double preloadBudget;
+
+    // texture memory allowed for the current orbit in bytes, from MISR_TEXTURE_MB
+    double textureBudget;
 
 
     /*************************************/
@@ -2,6 +2,7 @@
 
 #include "glutaux.h"
 #include "viewport.h"
+#include "colorize.h"
 
 viewport::viewport( std::string fileName )
 {
@@ -34,17 +35,17 @@ viewport::viewport( std::string fileName )
             blockY[i].resize( height );
             for ( int y = 0 ; y < height ; y++ )
                 blockY[i][y] = y * fields[i]->YDim() / height;
+
+            blockOffset[i].resize( width );
+            for ( int x = 0 ; x < width ; x++ )
+                blockOffset[i][x] = blockX[i][x] * fields[i]->YDim();
         }
 
-        // create channel data buffers
+        // read fill values
         for ( int i = 0 ; i < 3 ; i++ )
         {
             fillValue[i] = *(unsigned short *)fields[i]->FillValue();
-            channels[i].resize( fields[i]->XDim(), fields[i]->YDim() );
         }
-
-        // resize block image
-	    blockImage.resize( width * height * 4 );
     }
     else
     {
@@ -63,62 +64,192 @@ int viewport::MaxBlock() const
     return file->EndBlock();
 }
 
-void viewport::AllocTextures( int minBlock, int maxBlock )
+void viewport::AllocTextures( int minBlock, int maxBlock, int maxTextures )
 {
-    textures.resize( maxBlock + 1 );
-    glGenTextures( maxBlock - minBlock + 1, & textures[ minBlock ] );
+    textures.Alloc( minBlock, maxBlock, width, height, maxTextures, blockRenderer::IsSupported() );
+
+    if ( textures.IsArray() )
+    {
+        std::vector<hdfRect> rects;
+        for ( int block = minBlock ; block <= maxBlock ; block++ )
+        {
+            rects.push_back( file->BlockRect( block ) );
+        }
+
+        renderer.Alloc( minBlock, maxBlock, rects );
+    }
 }
 
-void viewport::DestroyTextures( int minBlock, int maxBlock )
+void viewport::DestroyTextures( int, int )
 {
-    glDeleteTextures( maxBlock - minBlock + 1, & textures[ minBlock ] );
+    renderer.Destroy();
+    textures.Destroy();
 }
 
-std::vector<unsigned char> & viewport::BlockImage( int blockIndex, double maxVal )
+void viewport::ReadBlock( int blockIndex, matrix<unsigned short> channels[3] ) const
 {
     for ( int i = 0 ; i < 3 ; i++ )
     {
+        if ( channels[i].numRows() != fields[i]->XDim() || channels[i].numCols() != fields[i]->YDim() )
+        {
+            channels[i].resize( fields[i]->XDim(), fields[i]->YDim() );
+        }
+
         fields[i]->ReadBlock( &channels[i](0,0), blockIndex );
     }
+}
+
+void viewport::ReadBlocks( int blockMin, int blockMax, matrix<unsigned short> * channels ) const
+{
+    if ( blockMin == blockMax )
+    {
+        ReadBlock( blockMin, channels );
+        return;
+    }
+
+    std::vector<unsigned short> run;
+
+    for ( int i = 0 ; i < 3 ; i++ )
+    {
+        const int blockSize = fields[i]->XDim() * fields[i]->YDim();
+        run.resize( blockSize * ( blockMax - blockMin + 1 ) );
+
+        fields[i]->ReadBlocks( &run[0], blockMin, blockMax );
+
+        // scatter the run into the buffers of each block
+        for ( int block = blockMin ; block <= blockMax ; block++ )
+        {
+            matrix<unsigned short> & channel = channels[ 3 * ( block - blockMin ) + i ];
+
+            if ( channel.numRows() != fields[i]->XDim() || channel.numCols() != fields[i]->YDim() )
+            {
+                channel.resize( fields[i]->XDim(), fields[i]->YDim() );
+            }
+
+            std::copy( run.begin() + ( block - blockMin ) * blockSize, run.begin() + ( block - blockMin + 1 ) * blockSize, &channel(0,0) );
+        }
+    }
+}
+
+void viewport::Colorize( const matrix<unsigned short> channels[3], double maxVal, std::vector<unsigned char> & image ) const
+{
+    std::vector<unsigned short> rowSamples[3];
+    colorizeRows eye;
+
+    BeginColorize( maxVal, rowSamples, image, eye );
+
+    for ( int y = 0 ; y < height ; y++, eye.pixel += 4 * width )
+    {
+        GatherRow( channels, y, rowSamples );
+        ColorizeRow( eye, width );
+    }
+}
+
+bool viewport::ColorizePair( const viewport & left, const matrix<unsigned short> leftChannels[3],
+                             const viewport & right, const matrix<unsigned short> rightChannels[3],
+                             double maxVal, std::vector<unsigned char> & leftImage, std::vector<unsigned char> & rightImage )
+{
+    if ( left.width != right.width || left.height != right.height )
+    {
+        return false;
+    }
+
+    std::vector<unsigned short> leftSamples[3];
+    std::vector<unsigned short> rightSamples[3];
+    colorizeRows leftEye;
+    colorizeRows rightEye;
+
+    left.BeginColorize( maxVal, leftSamples, leftImage, leftEye );
+    right.BeginColorize( maxVal, rightSamples, rightImage, rightEye );
+
+    for ( int y = 0 ; y < left.height ; y++ )
+    {
+        left.GatherRow( leftChannels, y, leftSamples );
+        right.GatherRow( rightChannels, y, rightSamples );
+
+        ColorizePairRow( leftEye, rightEye, left.width );
+
+        leftEye.pixel += 4 * left.width;
+        rightEye.pixel += 4 * right.width;
+    }
+
+    return true;
+}
 
-    const float rScale = 255 * fields[0]->Scale() / maxVal;
-    const float gScale = 255 * fields[1]->Scale() / maxVal;
-    const float bScale = 255 * fields[2]->Scale() / maxVal;
+void viewport::BeginColorize( double maxVal, std::vector<unsigned short> rowSamples[3], std::vector<unsigned char> & image, colorizeRows & eye ) const
+{
+    image.resize( width * height * 4 );
 
-    unsigned char * pixel = & blockImage[0];
-    
-    for ( int y = 0 ; y < height ; y++ )
+    // image rows run across the channels' rows, each row is gathered into contiguous samples first
+    for ( int i = 0 ; i < 3 ; i++ )
     {
-        for ( int x = 0 ; x < width ; x++, pixel += 4 )
+        rowSamples[i].resize( width );
+
+        eye.rows[i] = & rowSamples[i][0];
+        eye.scale[i] = float( 255 * fields[i]->Scale() / maxVal );
+        eye.fillValue[i] = fillValue[i];
+    }
+
+    eye.pixel = & image[0];
+}
+
+void viewport::GatherRow( const matrix<unsigned short> channels[3], int y, std::vector<unsigned short> rowSamples[3] ) const
+{
+    for ( int i = 0 ; i < 3 ; i++ )
+    {
+        // upsampled channels repeat the previous row
+        if ( y > 0 && blockY[i][y] == blockY[i][y - 1] )
+            continue;
+
+        const unsigned short * column = & channels[i]( 0, blockY[i][y] );
+        const int * offset = & blockOffset[i][0];
+        unsigned short * sample = & rowSamples[i][0];
+
+        for ( int x = 0 ; x < width ; x++ )
         {
-            unsigned short r = channels[0]( blockX[0][x], blockY[0][y] );
-            unsigned short g = channels[1]( blockX[1][x], blockY[1][y] );
-            unsigned short b = channels[2]( blockX[2][x], blockY[2][y] );
-            bool isTransparent = ( r == fillValue[0] ) || ( g == fillValue[1] ) || ( b == fillValue[2] );
-            
-            pixel[0] = ( unsigned char ) clamp( ( r >> 2 ) * rScale, 0.0f, 255.0f );
-            pixel[1] = ( unsigned char ) clamp( ( g >> 2 ) * gScale, 0.0f, 255.0f );
-            pixel[2] = ( unsigned char ) clamp( ( b >> 2 ) * bScale, 0.0f, 255.0f );
-    	    pixel[3] = isTransparent ? 0 : 255;
+            sample[x] = column[ offset[x] ];
         }
     }
+}
+
+bool viewport::CreateTextureFromImage( int blockIndex, const std::vector<unsigned char> & image )
+{
+    if ( ! textures.Upload( blockIndex, image ) )
+    {
+        return false;
+    }
+
+    if ( textures.IsArray() )
+    {
+        renderer.setLayer( blockIndex, textures.Layer( blockIndex ) );
+    }
 
-    return blockImage;
+    return true;
 }
 
-void viewport::CreateTextureFromImage( int blockIndex )
+void viewport::ReleaseTexture( int blockIndex )
 {
-    glBindTexture( GL_TEXTURE_2D, textures[ blockIndex ] );
-    
-    glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, & blockImage[0] );
+    textures.Release( blockIndex );
+}
 
-    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+bool viewport::HasTexture( int blockIndex ) const
+{
+    return textures.IsResident( blockIndex );
+}
 
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+int viewport::NumTextures() const
+{
+    return textures.NumResident();
+}
 
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+int viewport::MaxTextures() const
+{
+    return textures.MaxResident();
+}
+
+void viewport::setMaxTextures( int maxTextures )
+{
+    textures.setMaxResident( maxTextures );
 }
 
 vec2d viewport::BlockCenter( int blockIndex ) const
@@ -146,7 +277,7 @@ double viewport::PixelsPerMeter() const
 
 void viewport::DrawBlock( int blockIndex ) const
 {
-    glBindTexture( GL_TEXTURE_2D, textures[blockIndex] );
+    textures.Bind( blockIndex );
     hdfRect blockRect = file->BlockRect( blockIndex );
     glBegin( GL_TRIANGLE_STRIP );
     {
@@ -161,3 +292,20 @@ void viewport::DrawBlock( int blockIndex ) const
     }
     glEnd();
 }
+
+void viewport::DrawBlocks( int firstBlock, int lastBlock, const std::vector<bool> & textureValid ) const
+{
+    if ( textures.IsArray() )
+    {
+        renderer.Draw( textures, firstBlock, lastBlock, textureValid );
+        return;
+    }
+
+    for ( int block = firstBlock ; block <= lastBlock ; block++ )
+    {
+        if ( textureValid[ block ] )
+        {
+            DrawBlock( block );
+        }
+    }
+}
@@ -8,6 +8,9 @@
 #include "hdfFile.h"
 #include "hdfField.h"
 #include "hdfDataSource.h"
+#include "blockrenderer.h"
+#include "blocktextures.h"
+#include "colorize.h"
 
 #include "vec2.h"
 
@@ -23,17 +26,43 @@ public:
     // returns the maximum valid block index
     int MaxBlock() const;
 
-    // allocate opengl texture names
-    void AllocTextures( int minBlock, int maxBlock );
+    // prepare opengl textures for blocks minBlock to maxBlock, at most maxTextures of them at once
+    void AllocTextures( int minBlock, int maxBlock, int maxTextures );
 
-    // release opengl texture names
+    // release opengl textures
     void DestroyTextures( int minBlock, int maxBlock );
 
-    // returns a pointer to a RGBA image of merged channels
-    std::vector<unsigned char> & BlockImage( int blockIndex, double maxVal );
+    // reads the raw radiance of a block into the caller's channel buffers
+    // safe to call from several threads at once as long as each uses its own buffers
+    void ReadBlock( int blockIndex, matrix<unsigned short> channels[3] ) const;
+
+    // reads the raw radiance of blocks blockMin to blockMax with one hdf read per field
+    // channels holds 3 buffers per block, in block order
+    void ReadBlocks( int blockMin, int blockMax, matrix<unsigned short> * channels ) const;
+
+    // writes a RGBA image of merged channels scaled so maxVal is white
+    void Colorize( const matrix<unsigned short> channels[3], double maxVal, std::vector<unsigned char> & image ) const;
+
+    // colorizes both eyes of a stereo pair in one pass, blacking out pixels not valid in both
+    // returns false without writing anything if the eyes' images differ in size
+    static bool ColorizePair( const viewport & left, const matrix<unsigned short> leftChannels[3],
+                              const viewport & right, const matrix<unsigned short> rightChannels[3],
+                              double maxVal, std::vector<unsigned char> & leftImage, std::vector<unsigned char> & rightImage );
 
     // transfers image data to an opengl texture
-    void CreateTextureFromImage( int blockIndex );
+    // returns false if maxTextures blocks already have textures or texture memory ran out
+    bool CreateTextureFromImage( int blockIndex, const std::vector<unsigned char> & image );
+
+    // frees the texture of a block for another block
+    void ReleaseTexture( int blockIndex );
+
+    // returns true if a block has a texture
+    bool HasTexture( int blockIndex ) const;
+
+    // number of blocks with textures and the most allowed
+    int NumTextures() const;
+    int MaxTextures() const;
+    void setMaxTextures( int maxTextures );
 
     // returns the center of the block
     vec2d BlockCenter( int blockIndex ) const;
@@ -49,11 +78,18 @@ public:
     // draw the block using opengl
     void DrawBlock( int blockIndex ) const;
 
+    // draws blocks firstBlock to lastBlock whose textures are valid, in one call where the context allows
+    void DrawBlocks( int firstBlock, int lastBlock, const std::vector<bool> & textureValid ) const;
+
 protected:
 
+    // sizes image and points eye at rowSamples, image and this viewport's scales and fill values
+    void BeginColorize( double maxVal, std::vector<unsigned short> rowSamples[3], std::vector<unsigned char> & image, colorizeRows & eye ) const;
+
+    // gathers image row y of each channel into rowSamples, skipping channels that repeat row y - 1
+    void GatherRow( const matrix<unsigned short> channels[3], int y, std::vector<unsigned short> rowSamples[3] ) const;
+
     unsigned short fillValue[3];
-    matrix<unsigned short> channels[3];
-    std::vector<unsigned char> blockImage;
     int width, height;
     
     hdfFile file;
@@ -62,7 +98,11 @@ protected:
     std::vector<int> blockX[3];
     std::vector<int> blockY[3];
 
-    std::vector<GLuint> textures;
+    // offset of the first sample of image column x in each channel, blockX times the channel's row length
+    std::vector<int> blockOffset[3];
+
+    blockTextures textures;
+    blockRenderer renderer;
 };
 
 #endif // VIEWPORT_H_INCLUDED